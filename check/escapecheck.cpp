@@ -0,0 +1,364 @@
+#include "escapecheck.h"
+#include <grace/filesystem.h>
+#include <stdlib.h>
+#include "../common/htmlescape.h"
+#include "../xml2html/xmlhighlight.h"
+
+$appobject(escapecheckApp);
+
+//  -------------------------------------------------------------------------
+/// Gets at the scan kernels, which htmlescape only uses through scan().
+//  -------------------------------------------------------------------------
+class scankernels : public htmlescape
+{
+public:
+	static int		 scalar (const char *p, int sz, const char *set, int nset)
+					 {
+					 	return scanscalar (p, sz, set, nset);
+					 }
+
+#if defined(__SSE2__)
+	static int		 sse2 (const char *p, int sz, const char *set, int nset)
+					 {
+					 	return scansse2 (p, sz, set, nset);
+					 }
+#endif
+
+#if defined(HTMLESCAPE_AVX2)
+	static bool		 hasavx2 (void)
+					 {
+					 	return __builtin_cpu_supports ("avx2");
+					 }
+
+	static int		 avx2 (const char *p, int sz, const char *set, int nset)
+					 {
+					 	return scanavx2 (p, sz, set, nset);
+					 }
+#endif
+};
+
+//  =========================================================================
+/// grace2html's escaping before the shared kernel: tabs to the next
+/// multiple of 4, then <, > and &.
+//  =========================================================================
+static string *oldgrace2html (const string &l)
+{
+	returnclass (string) out retain;
+
+	for (int i=0; i<l.strlen(); ++i)
+	{
+		if (l[i] == '\t')
+		{
+			do
+			{
+				out.strcat (' ');
+			} while (out.strlen() & 3);
+		}
+		else if (l[i] == '<')
+		{
+			out.strcat ("&lt;");
+		}
+		else if (l[i] == '>')
+		{
+			out.strcat ("&gt;");
+		}
+		else if (l[i] == '&')
+		{
+			out.strcat ("&amp;");
+		}
+		else
+		{
+			out.strcat (l[i]);
+		}
+	}
+	return &out;
+}
+
+//  =========================================================================
+/// A line of mksite's %terminal output before the shared kernel.
+//  =========================================================================
+static string *oldterminal (const string &vln)
+{
+	returnclass (string) out retain;
+
+	string line = vln;
+	line.replace ($("$","$$")->$("<","&lt;")->$(">","&gt;"));
+	if (! line.strlen())
+	{
+		out.strcat ('\n');
+		return &out;
+	}
+	if (line[0] == '$')
+	{
+		line = line.mid (2);
+		out.strcat ("<span class=\"prompt\">%s</span>\n" %format (line));
+	}
+	else out.strcat ("%s\n" %format (line));
+	return &out;
+}
+
+//  =========================================================================
+/// The same line through the shared kernel, as printterminal does now.
+//  =========================================================================
+static string *newterminal (const string &vln)
+{
+	returnclass (string) out retain;
+
+	if (! vln.strlen())
+	{
+		out.strcat ('\n');
+		return &out;
+	}
+
+	const char *ln = vln.str();
+	int sz = vln.strlen();
+	bool prompt = (ln[0] == '$');
+	if (prompt)
+	{
+		out.strcat ("<span class=\"prompt\">");
+		ln++;
+		sz--;
+	}
+
+	htmlescape::escape (out, ln, sz, htmlescape::ltgt | htmlescape::dollar);
+	out.strcat (prompt ? "</span>\n" : "\n");
+	return &out;
+}
+
+//  =========================================================================
+/// A changelog line of parsechanges before the shared kernel.
+//  =========================================================================
+static string *oldchanges (const string &ln)
+{
+	returnclass (string) l retain;
+
+	l = ln;
+	l.chomp ();
+	l.replace ($("<","&lt;") -> $(">","&gt;"));
+	return &l;
+}
+
+//  =========================================================================
+/// xml2html's conversion before the shared kernel.
+//  =========================================================================
+static string *oldxml2html (const string &xml)
+{
+	returnclass (string) res retain;
+
+	for (int i=0; i<xml.strlen(); ++i)
+	{
+		if (xml[i] == '<')
+		{
+			bool inspan=true;
+			++i;
+			res.strcat ("<span class=\"xmltag\">&lt;");
+			while ((i<xml.strlen()) && (xml[i] != '>'))
+			{
+				if (xml[i] == '\"')
+				{
+					res.strcat ("</span><span class=\"string\">\"");
+					++i;
+					while ((i<xml.strlen()) && (xml[i] != '\"'))
+					{
+						res.strcat (xml[i]);
+						++i;
+					}
+					res.strcat ("\"</span><span class=\"xmlattr\">");
+				}
+				else if ((xml[i] == ' ') && inspan)
+				{
+					res.strcat ("</span> <span class=\"xmlattr\">");
+					inspan = false;
+				}
+				else res.strcat (xml[i]);
+				++i;
+			}
+			if (! inspan) res.strcat ("</span><span class=\"xmltag\">");
+			res.strcat ("&gt;</span>");
+		}
+		else if (xml[i] == ' ')
+		{
+			if (((i+1)<xml.strlen()) && (xml[i+1] == ' '))
+			{
+				res.strcat ("&nbsp;");
+				++i;
+			}
+			res.strcat (' ');
+		}
+		else if (xml[i] == '\t')
+		{
+			res.strcat ("&nbsp; &nbsp; ");
+		}
+		else if (xml[i] == '\n')
+		{
+			res.strcat ("<br/>\n");
+		}
+		else
+		{
+			res.strcat (xml[i]);
+		}
+	}
+	return &res;
+}
+
+// ==========================================================================
+// METHOD escapecheckApp::main
+// ==========================================================================
+int escapecheckApp::main (void)
+{
+	foreach (file, argv["*"])
+	{
+		if (! fs.exists (file)) continue;
+		string dat = fs.load (file);
+		check (file, dat);
+	}
+
+	srandom (argv["--seed"].ival());
+	int count = argv["--random"];
+	for (int i=0; i<count; ++i)
+	{
+		string dat = randominput ();
+		check ("random input %i" %format (i), dat);
+	}
+
+	fout.writeln ("%i inputs, %i comparisons, %i mismatches"
+				  %format (inputs, comparisons, mismatches));
+	return mismatches ? 1 : 0;
+}
+
+// ==========================================================================
+// METHOD escapecheckApp::check
+// ==========================================================================
+void escapecheckApp::check (const string &name, const string &dat)
+{
+	inputs++;
+
+	// The sets the tools pass to scan(), and a full one.
+	static const char *sets[] = {
+		"<>&\t", "<>$", "<>", "< \t\n", "\"> ", "\">", "\"",
+		"<>&$\t\" \n", NULL
+	};
+	for (int i=0; sets[i]; ++i) checkkernels (name, dat, sets[i]);
+
+	// The line escapers, a line at a time like the tools.
+	const char *p = dat.str();
+	int sz = dat.strlen();
+	int start = 0;
+	int lineno = 0;
+	while (start < sz)
+	{
+		int end = start;
+		while ((end < sz) && (p[end] != '\n')) ++end;
+		lineno++;
+
+		string ln;
+		if (end > start) ln.strcat (p + start, end - start);
+
+		string got;
+		htmlescape::escape (got, ln.str(), ln.strlen(),
+							htmlescape::ltgt | htmlescape::amp |
+							htmlescape::tabs);
+		string want = oldgrace2html (ln);
+		compare (name, "grace2html", lineno, want, got);
+
+		want = oldterminal (ln);
+		got = newterminal (ln);
+		compare (name, "%terminal", lineno, want, got);
+
+		got.crop ();
+		htmlescape::escape (got, ln.str(), ln.strlen(), htmlescape::ltgt);
+		got.chomp ();
+		want = oldchanges (ln);
+		compare (name, "parsechanges", lineno, want, got);
+
+		start = end + 1;
+	}
+
+	string xml;
+	xmlhighlight::convert (xml, dat.str(), dat.strlen());
+	string oldxml = oldxml2html (dat);
+	compare (name, "xml2html", 0, oldxml, xml);
+}
+
+// ==========================================================================
+// METHOD escapecheckApp::checkkernels
+// ==========================================================================
+void escapecheckApp::checkkernels (const string &name, const string &dat,
+								   const char *set)
+{
+	const char *p = dat.str();
+	int sz = dat.strlen();
+	int nset = strlen (set);
+	int pos = 0;
+
+	// Walks from one special byte to the next, so every match is
+	// seen once, starting at varying alignments.
+	while (pos <= sz)
+	{
+		int want = scankernels::scalar (p+pos, sz-pos, set, nset);
+		string wants = "%i" %format (want);
+
+#if defined(__SSE2__)
+		int got = scankernels::sse2 (p+pos, sz-pos, set, nset);
+		string gots = "%i" %format (got);
+		compare (name, "sse2 scan", pos, wants, gots);
+#endif
+#if defined(HTMLESCAPE_AVX2)
+		if (scankernels::hasavx2 ())
+		{
+			int agot = scankernels::avx2 (p+pos, sz-pos, set, nset);
+			string agots = "%i" %format (agot);
+			compare (name, "avx2 scan", pos, wants, agots);
+		}
+#endif
+
+		int sgot = htmlescape::scan (p+pos, sz-pos, set);
+		string sgots = "%i" %format (sgot);
+		compare (name, "scan", pos, wants, sgots);
+
+		pos += want + 1;
+	}
+}
+
+// ==========================================================================
+// METHOD escapecheckApp::compare
+// ==========================================================================
+bool escapecheckApp::compare (const string &name, const char *what, int line,
+							  const string &want, const string &got)
+{
+	comparisons++;
+	if (want == got) return true;
+
+	mismatches++;
+	string key = "%s %s" %format (name, what);
+	if (reported.exists (key)) return false;
+	reported[key] = true;
+
+	ferr.writeln ("%s: %s differs at %i" %format (name, what, line));
+	ferr.writeln ("   old: %s" %format (want));
+	ferr.writeln ("   new: %s" %format (got));
+	return false;
+}
+
+// ==========================================================================
+// METHOD escapecheckApp::randominput
+// ==========================================================================
+string *escapecheckApp::randominput (void)
+{
+	returnclass (string) res retain;
+	static const char special[] = "<>&$\t \n\"";
+
+	// Mostly short lines, now and then one long enough for the
+	// vector loops to run many steps.
+	int len = random() % 96;
+	if ((random() % 16) == 0) len = random() % 8192;
+
+	for (int i=0; i<len; ++i)
+	{
+		int pick = random() % 16;
+		if (pick < 8) res.strcat (special[pick]);
+		else if (pick < 14) res.strcat ((char) ('a' + (random() % 26)));
+		else res.strcat ((char) (128 + (random() % 128)));
+	}
+	return &res;
+}
@@ -0,0 +1,61 @@
+#ifndef _escapecheck_H
+#define _escapecheck_H 1
+#include <grace/application.h>
+
+//  -------------------------------------------------------------------------
+/// Main application class. Runs the escaping of the highlighters through
+/// the shared kernel and through the loops it replaced, and the scan
+/// kernels against each other, on a set of files and on random input.
+//  -------------------------------------------------------------------------
+class escapecheckApp : public application
+{
+public:
+		 	 escapecheckApp (void) :
+				application ("nl.madscience.tools.escapecheck")
+			 {
+			 	opt = $("-r", $("long", "--random")) ->
+			 		  $("-s", $("long", "--seed")) ->
+			 		  $("-h", $("long", "--help")) ->
+			 		  $("--random",
+			 		  		$("argc", 1) ->
+			 		  		$("default", 2000) ->
+			 		  		$("help", "Number of random inputs to check")
+			 		   ) ->
+			 		  $("--seed",
+			 		  		$("argc", 1) ->
+			 		  		$("default", 1) ->
+			 		  		$("help", "Seed for the random inputs")
+			 		   );
+			 	inputs = comparisons = mismatches = 0;
+			 }
+			~escapecheckApp (void)
+			 {
+			 }
+
+	int		 main (void);
+
+protected:
+			 /// Runs all checks on an input.
+			 /// \param name Shown with a mismatch.
+			 /// \param dat The input.
+	void	 check (const string &name, const string &dat);
+
+			 /// Compares the scan kernels for one set of special bytes.
+	void	 checkkernels (const string &name, const string &dat,
+						   const char *set);
+
+			 /// Compares two results and reports the first mismatch
+			 /// for a check and input.
+	bool	 compare (const string &name, const char *what, int line,
+					  const string &want, const string &got);
+
+			 /// A random input, biased to the bytes that get escaped.
+	string	*randominput (void);
+
+	int		 inputs; ///< Inputs checked.
+	int		 comparisons; ///< Results compared.
+	int		 mismatches; ///< Results that differed.
+	value	 reported; ///< Checks that reported a mismatch, per input.
+};
+
+#endif
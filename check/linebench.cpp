@@ -0,0 +1,141 @@
+#include "linebench.h"
+#include <grace/filesystem.h>
+#include <grace/strutil.h>
+#include <sys/time.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <new>
+#include "../common/linecursor.h"
+
+$appobject(linebenchApp);
+
+/// Calls to operator new since the program started.
+static unsigned long long newcalls = 0;
+
+//  =========================================================================
+/// Counting operator new for this program only; array and nothrow new
+/// end up here too.
+//  =========================================================================
+void *operator new (size_t sz)
+{
+	__atomic_add_fetch (&newcalls, 1, __ATOMIC_RELAXED);
+	void *p = malloc (sz ? sz : 1);
+	if (! p) throw std::bad_alloc ();
+	return p;
+}
+
+void operator delete (void *p) throw ()
+{
+	free (p);
+}
+
+void operator delete (void *p, size_t) throw ()
+{
+	free (p);
+}
+
+//  =========================================================================
+/// Bytes currently allocated from the heap.
+//  =========================================================================
+static size_t heapbytes (void)
+{
+#if defined (__GLIBC__) && ((__GLIBC__ > 2) || (__GLIBC_MINOR__ >= 33))
+	struct mallinfo2 mi = mallinfo2 ();
+#else
+	struct mallinfo mi = mallinfo ();
+#endif
+	return (size_t) mi.uordblks + (size_t) mi.hblkhd;
+}
+
+//  =========================================================================
+/// Current time in seconds.
+//  =========================================================================
+static double benchnow (void)
+{
+	struct timeval tv;
+	gettimeofday (&tv, NULL);
+	return tv.tv_sec + (tv.tv_usec / 1000000.0);
+}
+
+// ==========================================================================
+// METHOD linebenchApp::main
+// ==========================================================================
+int linebenchApp::main (void)
+{
+	string dat;
+	foreach (file, argv["*"])
+	{
+		dat.strcat (fs.load (file));
+	}
+
+	if (! dat.strlen())
+	{
+		// Changelog-like lines of varying length.
+		int n = argv["--lines"];
+		for (int i=0; i<n; ++i)
+		{
+			dat.strcat ("* line %i of the generated input" %format (i));
+			for (int j=0; j<(i%7); ++j) dat.strcat (" <with> some &more");
+			dat.strcat ('\n');
+		}
+	}
+
+	int rounds = argv["--rounds"];
+	if (rounds < 1) rounds = 1;
+
+	fout.writeln ("input: %i bytes, %i rounds" %format (dat.strlen(), rounds));
+	run ("splitlines", dat, rounds, false);
+	run ("linecursor", dat, rounds, true);
+	return 0;
+}
+
+// ==========================================================================
+// METHOD linebenchApp::run
+// ==========================================================================
+void linebenchApp::run (const char *name, const string &dat, int rounds,
+						bool cursor)
+{
+	unsigned long long calls = newcalls;
+	size_t peak = 0;
+	int nlines = 0;
+	int nbytes = 0;
+	double tstart = benchnow ();
+
+	for (int r=0; r<rounds; ++r)
+	{
+		size_t base = heapbytes ();
+		nlines = nbytes = 0;
+
+		if (cursor)
+		{
+			linecursor lines (dat);
+			while (lines.next())
+			{
+				nlines++;
+				nbytes += lines.length();
+			}
+			size_t now = heapbytes ();
+			if ((now > base) && ((now - base) > peak)) peak = now - base;
+		}
+		else
+		{
+			value lines = strutil::splitlines (dat);
+			foreach (line, lines)
+			{
+				nlines++;
+				nbytes += line.sval().strlen();
+			}
+			size_t now = heapbytes ();
+			if ((now > base) && ((now - base) > peak)) peak = now - base;
+		}
+	}
+
+	double t = benchnow () - tstart;
+	calls = newcalls - calls;
+
+	fout.writeln ("%s: %i lines, %i bytes of text" %format (name, nlines,
+				  nbytes));
+	fout.writeln ("   %.1f allocations/round, %.1f KB held, %.2f ms/round"
+				  %format ((double) calls / rounds, peak / 1024.0,
+						   (t * 1000.0) / rounds));
+}
@@ -0,0 +1,47 @@
+#ifndef _linebench_H
+#define _linebench_H 1
+#include <grace/application.h>
+
+//  -------------------------------------------------------------------------
+/// Main application class. Walks the lines of a buffer with
+/// strutil::splitlines and with linecursor, counting the allocations,
+/// the heap held and the time each takes.
+//  -------------------------------------------------------------------------
+class linebenchApp : public application
+{
+public:
+		 	 linebenchApp (void) :
+				application ("nl.madscience.tools.linebench")
+			 {
+			 	opt = $("-l", $("long", "--lines")) ->
+			 		  $("-r", $("long", "--rounds")) ->
+			 		  $("-h", $("long", "--help")) ->
+			 		  $("--lines",
+			 		  		$("argc", 1) ->
+			 		  		$("default", 200000) ->
+			 		  		$("help", "Lines of generated input, used when no "
+			 		  				  "files are given")
+			 		   ) ->
+			 		  $("--rounds",
+			 		  		$("argc", 1) ->
+			 		  		$("default", 10) ->
+			 		  		$("help", "Passes over the input per method")
+			 		   );
+			 }
+			~linebenchApp (void)
+			 {
+			 }
+
+	int		 main (void);
+
+protected:
+			 /// Runs one method over the input and prints its numbers.
+			 /// \param name Name of the method.
+			 /// \param dat The input.
+			 /// \param rounds Number of passes.
+			 /// \param cursor True for linecursor, false for splitlines.
+	void	 run (const char *name, const string &dat, int rounds,
+				  bool cursor);
+};
+
+#endif
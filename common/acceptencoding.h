@@ -0,0 +1,96 @@
+#ifndef _common_acceptencoding_H
+#define _common_acceptencoding_H 1
+#include <grace/str.h>
+#include <string.h>
+#include <strings.h>
+
+//  -------------------------------------------------------------------------
+/// Reads an Accept-encoding header. Codings are matched without case
+/// and a q value of 0 refuses a coding, also when * would allow it:
+///
+///   gzip;q=0, *    -> gzip not accepted
+///   *;q=0.5        -> gzip accepted
+///
+/// Nothing is allocated, so it can run on every request.
+//  -------------------------------------------------------------------------
+class acceptencoding
+{
+public:
+					 /// Checks if a header accepts gzip.
+					 /// \param hdr The header value.
+	static bool		 gzip (const string &hdr)
+					 {
+					 	return accepts (hdr.str(), hdr.strlen(), "gzip");
+					 }
+
+					 /// Checks if a header accepts a coding.
+					 /// \param p The header value.
+					 /// \param len Its length.
+					 /// \param coding The coding, in lower case.
+	static bool		 accepts (const char *p, unsigned int len,
+							  const char *coding)
+					 {
+					 	int clen = strlen (coding);
+					 	int named = -1; // q of the coding, if listed
+					 	int star = -1; // q of *, if listed
+					 	unsigned int i = 0;
+
+					 	while (i < len)
+					 	{
+					 		while ((i < len) && isblank (p[i])) ++i;
+					 		unsigned int st = i;
+					 		while ((i < len) && (p[i] != ',') &&
+					 			   (p[i] != ';') && (! isblank (p[i]))) ++i;
+					 		unsigned int nl = i - st;
+
+					 		int q = 1000;
+					 		while ((i < len) && (p[i] != ','))
+					 		{
+					 			if ((p[i] == 'q') && ((i+1) < len) &&
+					 				(p[i+1] == '=') && (i > st))
+					 			{
+					 				q = qvalue (p + i + 2, len - (i+2));
+					 			}
+					 			++i;
+					 		}
+					 		if (i < len) ++i;
+
+					 		if ((nl == 1) && (p[st] == '*')) star = q;
+					 		else if ((nl == (unsigned int) clen) &&
+					 				 (! strncasecmp (p + st, coding, clen)))
+					 		{
+					 			named = q;
+					 		}
+					 	}
+
+					 	if (named >= 0) return named > 0;
+					 	return star > 0;
+					 }
+
+protected:
+	static bool		 isblank (char c)
+					 {
+					 	return (c == ' ') || (c == '\t');
+					 }
+
+					 /// A q value in thousandths, at most three
+					 /// decimals are looked at.
+	static int		 qvalue (const char *p, unsigned int len)
+					 {
+					 	unsigned int i = 0;
+					 	if ((i >= len) || (p[i] < '0') || (p[i] > '1')) return 0;
+					 	int res = (p[i++] - '0') * 1000;
+					 	if ((i < len) && (p[i] == '.'))
+					 	{
+					 		++i;
+					 		for (int scale=100; scale && (i < len) &&
+					 			 (p[i] >= '0') && (p[i] <= '9'); scale /= 10)
+					 		{
+					 			res += (p[i++] - '0') * scale;
+					 		}
+					 	}
+					 	return (res > 1000) ? 1000 : res;
+					 }
+};
+
+#endif
@@ -0,0 +1,157 @@
+#ifndef _common_bundlepage_H
+#define _common_bundlepage_H 1
+#include <grace/httpd.h>
+#include <sys/sendfile.h>
+#include <errno.h>
+#include <string.h>
+#include "sitebundle.h"
+#include "acceptencoding.h"
+
+//  -------------------------------------------------------------------------
+/// An httpdobject that serves a site bundle. A request is a binary
+/// search in the mapped index, a write of the stored response header and
+/// a sendfile() of the body straight from the bundle file, without
+/// building strings or opening files. The precompressed body is sent to
+/// clients that accept gzip, and an If-None-Match holding the ETag of
+/// the body that would be sent gets a 304. Only GET and HEAD are
+/// answered; other methods and paths that aren't in the bundle are
+/// passed on down the chain.
+//  -------------------------------------------------------------------------
+class bundlepage : public httpdobject
+{
+public:
+					 /// Constructor.
+					 /// \param pparent The httpd to attach to.
+					 /// \param b The bundle, must stay open.
+					 bundlepage (httpd &pparent, const sitebundle &b)
+					 	: httpdobject (pparent, "*"), bundle (b),
+					 	  hinm ("If-none-match"), haccept ("Accept-encoding"),
+					 	  hmethod ("method")
+					 {
+					 }
+					~bundlepage (void)
+					 {
+					 }
+
+	int				 run (string &uri, string &postbody, value &inhdr,
+						  string &out, value &outhdr, value &env,
+						  tcpsocket &s)
+					 {
+					 	const string &method = env[hmethod].sval();
+					 	bool head = (method == "HEAD");
+					 	if ((! head) && (method != "GET")) return 0;
+
+					 	const char *p = uri.str();
+					 	unsigned int len = uri.strlen();
+					 	const char *q = (const char *) memchr (p, '?', len);
+					 	if (q) len = q - p;
+
+					 	const bundleentry *e = bundle.find (p, len);
+					 	if ((! e) && len && (p[len-1] == '/') && (len < 500))
+					 	{
+					 		char idx[512];
+					 		memcpy (idx, p, len);
+					 		memcpy (idx + len, "index.html", 10);
+					 		e = bundle.find (idx, len + 10);
+					 	}
+					 	if (! e) return 0;
+
+					 	// Pick the representation first, the ETag to
+					 	// compare depends on it.
+					 	bool gz = false;
+					 	if (e->gzsize && inhdr.exists (haccept))
+					 	{
+					 		gz = acceptencoding::gzip (inhdr[haccept].sval());
+					 	}
+
+					 	int fd = s.filno ();
+
+					 	if (inhdr.exists (hinm))
+					 	{
+					 		const string &inm = inhdr[hinm].sval();
+					 		bool hit = gz ?
+					 			etagmatch (inm, bundle.at (e->gzetagoff), e->gzetaglen) :
+					 			etagmatch (inm, bundle.at (e->etagoff), e->etaglen);
+					 		if (hit)
+					 		{
+					 			if (gz) writeall (fd, bundle.at (e->gznmhdroff), e->gznmhdrlen);
+					 			else writeall (fd, bundle.at (e->nmhdroff), e->nmhdrlen);
+					 			return -304;
+					 		}
+					 	}
+
+					 	if (gz) writeall (fd, bundle.at (e->gzhdroff), e->gzhdrlen);
+					 	else writeall (fd, bundle.at (e->hdroff), e->hdrlen);
+
+					 	if (! head)
+					 	{
+					 		if (gz) sendall (fd, e->gzoff, e->gzsize);
+					 		else sendall (fd, e->dataoff, e->datasize);
+					 	}
+					 	return -200;
+					 }
+
+protected:
+					 /// Checks if an If-None-Match header lists an ETag.
+					 /// Weak entries compare by their tag, * matches.
+	static bool		 etagmatch (const string &inm, const char *etag,
+								unsigned int len)
+					 {
+					 	const char *p = inm.str();
+					 	unsigned int sz = inm.strlen();
+					 	unsigned int i = 0;
+					 	while (i < sz)
+					 	{
+					 		while ((i < sz) && ((p[i] == ' ') || (p[i] == ',') ||
+					 							(p[i] == '\t'))) ++i;
+					 		if ((i+1 < sz) && (p[i] == 'W') && (p[i+1] == '/')) i += 2;
+					 		unsigned int st = i;
+					 		while ((i < sz) && (p[i] != ',') && (p[i] != ' ') &&
+					 			   (p[i] != '\t')) ++i;
+					 		unsigned int n = i - st;
+					 		if ((n == 1) && (p[st] == '*')) return true;
+					 		if ((n == len) && (! memcmp (p + st, etag, len))) return true;
+					 	}
+					 	return false;
+					 }
+
+					 /// Write a buffer to a socket.
+	static void		 writeall (int fd, const char *p, size_t sz)
+					 {
+					 	while (sz)
+					 	{
+					 		ssize_t n = ::write (fd, p, sz);
+					 		if (n < 0)
+					 		{
+					 			if (errno == EINTR) continue;
+					 			return;
+					 		}
+					 		p += n;
+					 		sz -= n;
+					 	}
+					 }
+
+					 /// Send a range of the bundle file to a socket.
+	void			 sendall (int fd, uint64_t off, uint64_t sz)
+					 {
+					 	off_t pos = off;
+					 	while (sz)
+					 	{
+					 		ssize_t n = sendfile (fd, bundle.fd, &pos, sz);
+					 		if (n < 0)
+					 		{
+					 			if (errno == EINTR) continue;
+					 			return;
+					 		}
+					 		if (n == 0) return;
+					 		sz -= n;
+					 	}
+					 }
+
+	const sitebundle &bundle; ///< The bundle.
+	statstring		 hinm; ///< Header name, made once.
+	statstring		 haccept; ///< Header name, made once.
+	statstring		 hmethod; ///< Environment key, made once.
+};
+
+#endif
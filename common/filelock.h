@@ -0,0 +1,35 @@
+#ifndef _common_filelock_H
+#define _common_filelock_H 1
+#include <grace/str.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+//  -------------------------------------------------------------------------
+/// Scoped exclusive lock on a lock file, for state files that several
+/// tool processes of a parallel build read and write.
+//  -------------------------------------------------------------------------
+class filelock
+{
+public:
+					 /// Constructor, blocks until the lock is held.
+					 /// \param path The lock file, created if needed.
+					 filelock (const string &path)
+					 {
+					 	fd = ::open (path.str(), O_CREAT | O_RDWR, 0644);
+					 	if (fd >= 0) flock (fd, LOCK_EX);
+					 }
+					 
+					 /// Destructor, releases the lock.
+					~filelock (void)
+					 {
+					 	if (fd < 0) return;
+					 	flock (fd, LOCK_UN);
+					 	::close (fd);
+					 }
+
+protected:
+	int				 fd; ///< Descriptor of the lock file.
+};
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef _common_htmlescape_H
+#define _common_htmlescape_H 1
+#include <grace/str.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+  #include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  #include <immintrin.h>
+  #define HTMLESCAPE_AVX2 1
+#endif
+
+//  -------------------------------------------------------------------------
+/// Escaping kernel shared by the highlighters. Runs of bytes that need no
+/// escaping are found 16 (SSE2) or 32 (AVX2) bytes at a time and copied
+/// in bulk; only the special bytes take the scalar path. AVX2 is picked
+/// at runtime when the CPU has it, other platforms use plain C.
+//  -------------------------------------------------------------------------
+class htmlescape
+{
+public:
+	/// Flags for escape().
+	enum {
+		ltgt = 0x01, ///< Escape < and > as &lt; and &gt;.
+		amp = 0x02, ///< Escape & as &amp;.
+		dollar = 0x04, ///< Double $ for the template parser.
+		tabs = 0x08 ///< Expand tabs to the next multiple of 4.
+	};
+
+					 /// Finds the first byte in a range that is one of a
+					 /// set of (at most 8) special bytes.
+					 /// \param p Start of the range.
+					 /// \param sz Size of the range.
+					 /// \param set Nul-terminated set of special bytes.
+					 /// \return Offset of the first special byte, or sz.
+	static int		 scan (const char *p, int sz, const char *set)
+					 {
+					 	static int (*impl)(const char *, int, const char *, int)
+					 		= pickscan ();
+					 	int nset = strlen (set);
+					 	if (! nset) return sz;
+					 	return impl (p, sz, set, nset > 8 ? 8 : nset);
+					 }
+
+					 /// Appends an escaped copy of a range to a string.
+					 /// \param into The string to append to.
+					 /// \param p Start of the range.
+					 /// \param sz Size of the range.
+					 /// \param flags Combination of the flags above.
+					 /// \param linestart Offset in into where the current
+					 ///                  line starts, for tab expansion.
+	static void		 escape (string &into, const char *p, int sz,
+							 int flags, int linestart = 0)
+					 {
+					 	char set[8];
+					 	int nset = 0;
+					 	if (flags & ltgt) { set[nset++] = '<'; set[nset++] = '>'; }
+					 	if (flags & amp) set[nset++] = '&';
+					 	if (flags & dollar) set[nset++] = '$';
+					 	if (flags & tabs) set[nset++] = '\t';
+					 	set[nset] = 0;
+
+					 	int start = 0;
+					 	while (start < sz)
+					 	{
+					 		int i = start + scan (p + start, sz - start, set);
+					 		if (i > start) into.strcat (p + start, i - start);
+					 		if (i >= sz) break;
+
+					 		switch (p[i])
+					 		{
+					 			case '<': into.strcat ("&lt;"); break;
+					 			case '>': into.strcat ("&gt;"); break;
+					 			case '&': into.strcat ("&amp;"); break;
+					 			case '$': into.strcat ("$$"); break;
+					 			case '\t':
+					 				do
+					 				{
+					 					into.strcat (' ');
+					 				} while ((into.strlen() - linestart) & 3);
+					 				break;
+					 		}
+					 		start = i+1;
+					 	}
+					 }
+
+					 /// Escapes a string.
+					 /// \param src The string to escape.
+					 /// \param flags Combination of the flags above.
+					 /// \return New string with the escaped data.
+	static string	*escape (const string &src, int flags)
+					 {
+					 	returnclass (string) res retain;
+					 	escape (res, src.str(), src.strlen(), flags);
+					 	return &res;
+					 }
+
+protected:
+					 /// Plain C version of scan().
+	static int		 scanscalar (const char *p, int sz, const char *set,
+								 int nset)
+					 {
+					 	for (int i=0; i<sz; ++i)
+					 	{
+					 		for (int k=0; k<nset; ++k)
+					 		{
+					 			if (p[i] == set[k]) return i;
+					 		}
+					 	}
+					 	return sz;
+					 }
+
+#if defined(__SSE2__)
+					 /// SSE2 version of scan(), 16 bytes per step.
+	static int		 scansse2 (const char *p, int sz, const char *set,
+							   int nset)
+					 {
+					 	__m128i v[8];
+					 	for (int k=0; k<nset; ++k) v[k] = _mm_set1_epi8 (set[k]);
+
+					 	int i = 0;
+					 	for (; (i+16) <= sz; i += 16)
+					 	{
+					 		__m128i d = _mm_loadu_si128 ((const __m128i *) (p+i));
+					 		__m128i m = _mm_cmpeq_epi8 (d, v[0]);
+					 		for (int k=1; k<nset; ++k)
+					 		{
+					 			m = _mm_or_si128 (m, _mm_cmpeq_epi8 (d, v[k]));
+					 		}
+					 		int mask = _mm_movemask_epi8 (m);
+					 		if (mask) return i + __builtin_ctz (mask);
+					 	}
+					 	return i + scanscalar (p+i, sz-i, set, nset);
+					 }
+#endif
+
+#if defined(HTMLESCAPE_AVX2)
+					 /// AVX2 version of scan(), 32 bytes per step.
+	__attribute__((target("avx2")))
+	static int		 scanavx2 (const char *p, int sz, const char *set,
+							   int nset)
+					 {
+					 	__m256i v[8];
+					 	for (int k=0; k<nset; ++k) v[k] = _mm256_set1_epi8 (set[k]);
+
+					 	int i = 0;
+					 	for (; (i+32) <= sz; i += 32)
+					 	{
+					 		__m256i d = _mm256_loadu_si256 ((const __m256i *) (p+i));
+					 		__m256i m = _mm256_cmpeq_epi8 (d, v[0]);
+					 		for (int k=1; k<nset; ++k)
+					 		{
+					 			m = _mm256_or_si256 (m, _mm256_cmpeq_epi8 (d, v[k]));
+					 		}
+					 		unsigned int mask = _mm256_movemask_epi8 (m);
+					 		if (mask) return i + __builtin_ctz (mask);
+					 	}
+					 	return i + scanscalar (p+i, sz-i, set, nset);
+					 }
+#endif
+
+					 /// Picks the best scan() implementation for this CPU.
+	static int		(*pickscan (void))(const char *, int, const char *, int)
+					 {
+#if defined(HTMLESCAPE_AVX2)
+					 	if (__builtin_cpu_supports ("avx2")) return scanavx2;
+#endif
+#if defined(__SSE2__)
+					 	return scansse2;
+#else
+					 	return scanscalar;
+#endif
+					 }
+};
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef _common_linecursor_H
+#define _common_linecursor_H 1
+#include <grace/str.h>
+#include <string.h>
+
+//  -------------------------------------------------------------------------
+/// Non-owning cursor over the lines of a loaded buffer. Replaces splitting
+/// a file into a value array of line strings: lines are handed out as a
+/// pointer and length into the original buffer, and are only copied when
+/// the caller asks for a string. The buffer must outlive the cursor.
+//  -------------------------------------------------------------------------
+class linecursor
+{
+public:
+					 /// Constructor.
+					 /// \param buf The buffer to iterate.
+					 /// \param wholelines If true, behave like splitting
+					 ///                   on newlines and dropping the
+					 ///                   last element: text after the
+					 ///                   last newline is not returned
+					 ///                   and carriage returns are kept.
+					 /// \param from Offset to start at, should be the start
+					 ///             of a line.
+					 /// \param to Offset to stop at, -1 for the end of the
+					 ///           buffer.
+					 linecursor (const string &buf, bool wholelines = false,
+								 int from = 0, int to = -1)
+					 {
+					 	data = buf.str();
+					 	size = ((to < 0) || (to > (int) buf.strlen())) ?
+					 				(int) buf.strlen() : to;
+					 	pos = from;
+					 	len = 0;
+					 	nextpos = from;
+					 	complete = wholelines;
+					 }
+					~linecursor (void)
+					 {
+					 }
+
+					 /// Advance to the next line.
+					 /// \return False if there are no more lines.
+	bool			 next (void)
+					 {
+					 	if (nextpos >= size) return false;
+					 	pos = nextpos;
+					 	const char *nl = (const char *)
+					 		memchr (data + pos, '\n', size - pos);
+					 	if (! nl)
+					 	{
+					 		if (complete) return false;
+					 		len = size - pos;
+					 		nextpos = size;
+					 	}
+					 	else
+					 	{
+					 		len = nl - (data + pos);
+					 		nextpos = pos + len + 1;
+					 	}
+					 	if ((! complete) && len && (data[pos+len-1] == '\r')) len--;
+					 	return true;
+					 }
+
+					 /// Offset of the current line in the buffer.
+	int				 offset (void) const { return pos; }
+
+					 /// Start of the current line, not nul-terminated.
+	const char		*line (void) const { return data + pos; }
+
+					 /// Length of the current line, without line ending.
+	int				 length (void) const { return len; }
+
+					 /// Character at an offset in the current line, 0 past
+					 /// the end.
+	char			 operator[] (int i) const
+					 {
+					 	return ((i>=0) && (i<len)) ? data[pos+i] : 0;
+					 }
+
+					 /// Compare the current line to a string.
+	bool			 operator== (const char *s) const
+					 {
+					 	return (strlen (s) == (size_t) len) &&
+					 		   (! memcmp (s, data + pos, len));
+					 }
+
+					 /// Append the current line to a string.
+	void			 appendto (string &into) const
+					 {
+					 	if (len) into.strcat (data + pos, len);
+					 }
+
+					 /// Copy of the current line.
+	string			*str (void) const
+					 {
+					 	returnclass (string) res retain;
+					 	appendto (res);
+					 	return &res;
+					 }
+
+protected:
+	const char		*data; ///< The buffer.
+	int				 size; ///< Size of the buffer.
+	int				 pos; ///< Offset of the current line.
+	int				 len; ///< Length of the current line.
+	int				 nextpos; ///< Offset of the next line.
+	bool			 complete; ///< Only return newline-terminated lines.
+};
+
+#endif
@@ -0,0 +1,179 @@
+#ifndef _common_sitebundle_H
+#define _common_sitebundle_H 1
+#include <grace/str.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/// Magic at the start of a bundle file.
+#define SITEBUNDLE_MAGIC "GRBNDL02"
+
+/// Byte order mark, bundles are written in host byte order.
+#define SITEBUNDLE_BOM 0x01020304
+
+/// Alignment of the data blobs in the file.
+#define SITEBUNDLE_ALIGN 64
+
+//  -------------------------------------------------------------------------
+/// Bundle file header, at offset 0.
+//  -------------------------------------------------------------------------
+struct bundleheader
+{
+	char			 magic[8]; ///< SITEBUNDLE_MAGIC.
+	uint32_t		 bom; ///< SITEBUNDLE_BOM.
+	uint32_t		 count; ///< Number of entries.
+	uint64_t		 indexoff; ///< Offset of the entry table.
+	uint64_t		 size; ///< Size of the file.
+};
+
+//  -------------------------------------------------------------------------
+/// Index entry for one file. Entries are sorted by path (bytewise, a
+/// shorter path sorts before a longer one with the same prefix). All
+/// offsets are from the start of the bundle. The headers are complete
+/// HTTP response headers, ready to write to a socket. The raw and gzip
+/// bytes are different representations, so each has its own ETag and
+/// its own 304 header.
+//  -------------------------------------------------------------------------
+struct bundleentry
+{
+	uint64_t		 pathoff; ///< Path, starting with a slash.
+	uint64_t		 typeoff; ///< Content type.
+	uint64_t		 etagoff; ///< Quoted ETag of the raw bytes.
+	uint64_t		 gzetagoff; ///< Quoted ETag of the gzip bytes.
+	uint64_t		 hdroff; ///< 200 response header for the raw bytes.
+	uint64_t		 gzhdroff; ///< 200 response header for the gzip bytes.
+	uint64_t		 nmhdroff; ///< 304 response header for the raw bytes.
+	uint64_t		 gznmhdroff; ///< 304 response header for the gzip bytes.
+	uint64_t		 dataoff; ///< Raw bytes.
+	uint64_t		 datasize; ///< Size of the raw bytes.
+	uint64_t		 gzoff; ///< Precompressed bytes.
+	uint64_t		 gzsize; ///< Size of the precompressed bytes, or 0.
+	uint32_t		 pathlen; ///< Length of the path.
+	uint32_t		 typelen; ///< Length of the content type.
+	uint32_t		 etaglen; ///< Length of the raw ETag.
+	uint32_t		 gzetaglen; ///< Length of the gzip ETag.
+	uint32_t		 hdrlen; ///< Length of the raw header.
+	uint32_t		 gzhdrlen; ///< Length of the gzip header.
+	uint32_t		 nmhdrlen; ///< Length of the raw 304 header.
+	uint32_t		 gznmhdrlen; ///< Length of the gzip 304 header.
+};
+
+//  -------------------------------------------------------------------------
+/// Read-only view of a site bundle, mapped into memory. Lookups are a
+/// binary search over the mapped index and don't allocate.
+//  -------------------------------------------------------------------------
+class sitebundle
+{
+public:
+					 sitebundle (void)
+					 {
+					 	fd = -1;
+					 	base = NULL;
+					 	size = 0;
+					 	hdr = NULL;
+					 	index = NULL;
+					 }
+					~sitebundle (void)
+					 {
+					 	close ();
+					 }
+
+					 /// Map a bundle file.
+					 /// \param path The file.
+					 /// \return False if it can't be read or isn't a
+					 ///         bundle for this host.
+	bool			 open (const string &path)
+					 {
+					 	close ();
+					 	fd = ::open (path.str(), O_RDONLY);
+					 	if (fd < 0) return false;
+
+					 	struct stat st;
+					 	if ((fstat (fd, &st) != 0) ||
+					 		(st.st_size < (off_t) sizeof (bundleheader)))
+					 	{
+					 		close ();
+					 		return false;
+					 	}
+
+					 	size = st.st_size;
+					 	void *m = mmap (NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+					 	if (m == MAP_FAILED)
+					 	{
+					 		close ();
+					 		return false;
+					 	}
+
+					 	base = (const char *) m;
+					 	hdr = (const bundleheader *) base;
+					 	if (memcmp (hdr->magic, SITEBUNDLE_MAGIC, 8) ||
+					 		(hdr->bom != SITEBUNDLE_BOM) ||
+					 		(hdr->size != size) ||
+					 		((hdr->indexoff + (hdr->count * sizeof (bundleentry)))
+					 			> size))
+					 	{
+					 		close ();
+					 		return false;
+					 	}
+
+					 	index = (const bundleentry *) (base + hdr->indexoff);
+					 	return true;
+					 }
+
+					 /// Unmap the bundle.
+	void			 close (void)
+					 {
+					 	if (base) munmap ((void *) base, size);
+					 	if (fd >= 0) ::close (fd);
+					 	fd = -1;
+					 	base = NULL;
+					 	hdr = NULL;
+					 	index = NULL;
+					 	size = 0;
+					 }
+
+					 /// Find the entry for a path.
+					 /// \param path The path, need not be nul-terminated.
+					 /// \param len Length of the path.
+					 /// \return The entry, or NULL.
+	const bundleentry *find (const char *path, unsigned int len) const
+					 {
+					 	if (! index) return NULL;
+
+					 	int lo = 0;
+					 	int hi = (int) hdr->count - 1;
+					 	while (lo <= hi)
+					 	{
+					 		int mid = (lo + hi) / 2;
+					 		const bundleentry &e = index[mid];
+					 		unsigned int n = (e.pathlen < len) ? e.pathlen : len;
+					 		int c = memcmp (base + e.pathoff, path, n);
+					 		if (! c) c = (int) e.pathlen - (int) len;
+					 		if (! c) return &e;
+					 		if (c < 0) lo = mid+1;
+					 		else hi = mid-1;
+					 	}
+					 	return NULL;
+					 }
+
+					 /// Pointer to an offset in the bundle.
+	const char		*at (uint64_t off) const { return base + off; }
+
+					 /// Number of entries.
+	int				 count (void) const { return hdr ? hdr->count : 0; }
+
+					 /// The open file, for sendfile().
+	int				 fd;
+
+protected:
+	const char		*base; ///< Start of the mapping.
+	size_t			 size; ///< Size of the mapping.
+	const bundleheader *hdr; ///< The header.
+	const bundleentry *index; ///< The entry table.
+};
+
+#endif
@@ -2,6 +2,23 @@
 #define _grace2html_H 1
 #include <grace/application.h>
 
+class linecursor;
+
+//  -------------------------------------------------------------------------
+/// Lexer state that carries over from one line to the next.
+//  -------------------------------------------------------------------------
+struct lexstate
+{
+					 lexstate (void)
+					 {
+					 	indouble = insingle = inccomment = false;
+					 }
+					 
+	bool			 indouble; ///< Inside a double-quoted string.
+	bool			 insingle; ///< Inside a single-quoted string.
+	bool			 inccomment; ///< Inside a C-style comment.
+};
+
 //  -------------------------------------------------------------------------
 /// Main application class.
 //  -------------------------------------------------------------------------
@@ -11,12 +28,31 @@ public:
 		 	 grace2htmlApp (void) :
 				application ("nl.madscience.tools.grace2html")
 			 {
+			 	opt = $("-j", $("long", "--jobs")) ->
+			 		  $("-h", $("long", "--help")) ->
+			 		  $("--jobs",
+			 		  		$("argc", 1) ->
+			 		  		$("default", 0) ->
+			 		  		$("help", "Number of threads, 0 for one per core")
+			 		   ) ->
+			 		  $("--parallel-size",
+			 		  		$("argc", 1) ->
+			 		  		$("default", 1048576) ->
+			 		  		$("help", "Minimum input size for parallel mode")
+			 		   );
 			 }
 			~grace2htmlApp (void)
 			 {
 			 }
 
 	int		 main (void);
+	void	 highlightrange (const string &, int, int, lexstate &, string &);
+	void	 highlightparallel (const string &, int);
+	void	 highlightline (const linecursor &, lexstate &, string &);
+	
+	static void scanline (const char *, int, lexstate &);
+	
+	value	 kwdb;
 };
 
 #endif
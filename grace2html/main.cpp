@@ -1,9 +1,38 @@
 #include "grace2html.h"
 #include <grace/filesystem.h>
 #include <grace/strutil.h>
+#include "../common/linecursor.h"
+#include "../common/htmlescape.h"
+#include <pthread.h>
+#include <unistd.h>
 
 APPOBJECT(grace2htmlApp);
 
+//  -------------------------------------------------------------------------
+/// A range of lines highlighted by one thread in parallel mode.
+//  -------------------------------------------------------------------------
+struct lexchunk
+{
+	grace2htmlApp	*app; ///< The application, for its keyword table.
+	const string	*code; ///< The full source.
+	int				 from; ///< Offset of the first line.
+	int				 to; ///< Offset past the last line.
+	lexstate		 st; ///< Lexer state at the first line.
+	string			 out; ///< Highlighted output.
+	pthread_t		 tid; ///< Worker thread.
+	bool			 threaded; ///< True if tid is a thread to join.
+};
+
+//  =========================================================================
+/// Thread entry point for a lexchunk.
+//  =========================================================================
+static void *lexchunkrun (void *arg)
+{
+	lexchunk *c = (lexchunk *) arg;
+	c->app->highlightrange (*c->code, c->from, c->to, c->st, c->out);
+	return NULL;
+}
+
 //  =========================================================================
 /// Main method.
 //  =========================================================================
@@ -11,12 +40,8 @@ int grace2htmlApp::main (void)
 {
 	string code;
 	code = fs.load (argv["*"][0]);
-	bool indouble = false;
-	bool insingle = false;
-	bool inccomment = false;
-	bool incppcomment = false;
 	
-	value kwdb =
+	kwdb =
 		$("bool", 1) ->
 		$("true", 1) ->
 		$("false", 1) ->
@@ -61,142 +86,264 @@ int grace2htmlApp::main (void)
 		$("appobject", 1) ->
 		$("%format", 1);
 	
-	value lines = strutil::split (code, '\n');
+	int jobs = argv["--jobs"];
+	if (jobs < 1) jobs = sysconf (_SC_NPROCESSORS_ONLN);
 	
 	fout.writeln ("<div class=\"code\"><pre>");
-	lines.rmindex (-1);
 	
-	foreach (line, lines)
+	if ((jobs > 1) && (code.strlen() >= argv["--parallel-size"].ival()))
 	{
-		string l = line;
+		highlightparallel (code, jobs);
+	}
+	else
+	{
+		lexstate st;
 		string out;
+		highlightrange (code, 0, -1, st, out);
+		fout.puts (out);
+	}
+	
+	fout.writeln ("</pre></div>");
+	
+	return 0;
+}
+
+//  =========================================================================
+/// Highlights a range of lines.
+/// \param code The full source.
+/// \param from Offset of the first line.
+/// \param to Offset past the last line, -1 for the end.
+/// \param st The lexer state, updated as lines are processed.
+/// \param into Output string, lines are appended.
+//  =========================================================================
+void grace2htmlApp::highlightrange (const string &code, int from, int to,
+									lexstate &st, string &into)
+{
+	linecursor lines (code, true, from, to);
+	while (lines.next())
+	{
+		highlightline (lines, st, into);
+	}
+}
+
+//  =========================================================================
+/// Splits the source into line-aligned chunks and highlights them on
+/// separate threads. A fast pass over the source, which only tracks the
+/// lexer state, gives every chunk its exact starting state, so the
+/// stitched result is identical to the sequential output.
+/// \param code The full source.
+/// \param jobs Number of chunks.
+//  =========================================================================
+void grace2htmlApp::highlightparallel (const string &code, int jobs)
+{
+	lexchunk *chunks = new lexchunk[jobs];
+	int nchunks = 0;
+	int target = 0;
+	lexstate st;
+	
+	linecursor lines (code, true);
+	while (lines.next())
+	{
+		if (lines.offset() >= target)
+		{
+			if (nchunks) chunks[nchunks-1].to = lines.offset();
+			lexchunk &c = chunks[nchunks++];
+			c.app = this;
+			c.code = &code;
+			c.from = lines.offset();
+			c.to = -1;
+			c.st = st;
+			
+			target = (nchunks < jobs) ?
+				(int) (((long long) code.strlen() * nchunks) / jobs) :
+				code.strlen() + 1;
+		}
+		scanline (lines.line(), lines.length(), st);
+	}
+	
+	// Chunks don't depend on each other, one that can't get a thread
+	// is done right here.
+	for (int i=1; i<nchunks; ++i)
+	{
+		chunks[i].threaded = (pthread_create (&chunks[i].tid, NULL,
+											  lexchunkrun, &chunks[i]) == 0);
+		if (! chunks[i].threaded) lexchunkrun (&chunks[i]);
+	}
+	if (nchunks) lexchunkrun (&chunks[0]);
+	
+	for (int i=0; i<nchunks; ++i)
+	{
+		if (i && chunks[i].threaded) pthread_join (chunks[i].tid, NULL);
+		fout.puts (chunks[i].out);
+	}
+	
+	delete[] chunks;
+}
+
+//  =========================================================================
+/// Tracks the lexer state across a line without generating output. Must
+/// follow the state transitions of highlightline() exactly. HTML escaping
+/// and keyword matching never touch the characters involved, so the raw
+/// line can be scanned.
+/// \param l The raw line.
+/// \param sz Length of the line.
+/// \param st The lexer state.
+//  =========================================================================
+void grace2htmlApp::scanline (const char *l, int sz, lexstate &st)
+{
+	bool incppcomment = false;
+	
+	for (int i=0; i<sz; ++i)
+	{
+		char next = ((i+1) < sz) ? l[i+1] : 0;
 		
-		for (int i=0; i<l.strlen(); ++i)
+		if (l[i] == '\\')
 		{
-			if (l[i] == '\t')
-			{
-				do
-				{
-					out.strcat (' ');
-				} while (out.strlen() & 3);
-			}
-			else if (l[i] == '<')
-			{
-				out.strcat ("&lt;");
-			}
-			else if (l[i] == '>')
-			{
-				out.strcat ("&gt;");
-			}
-			else if (l[i] == '&')
+			++i;
+		}
+		else if ((l[i] == '\"') && (! st.insingle) && (! st.inccomment) &&
+				 (! incppcomment))
+		{
+			st.indouble = !st.indouble;
+		}
+		else if ((l[i] == '\'') && (! st.indouble) && (! st.inccomment) &&
+				 (! incppcomment))
+		{
+			st.insingle = !st.insingle;
+		}
+		else if ((l[i] == '#') && (! incppcomment) &&
+				 (! st.insingle) && (! st.indouble))
+		{
+			incppcomment = true;
+		}
+		else if ((l[i] == '/') && (! incppcomment) &&
+				 (! st.inccomment) && (! st.insingle) && (! st.indouble))
+		{
+			if (next == '/')
 			{
-				out.strcat ("&amp;");
+				incppcomment = true;
+				++i;
 			}
-			else
+			else if (next == '*')
 			{
-				out.strcat (l[i]);
+				st.inccomment = true;
+				++i;
 			}
 		}
-		
-		l = out;
-		out.crop ();
-		
-		for (int i=0; i<l.strlen(); ++i)
+		else if (st.inccomment && (l[i] == '*') && (next == '/'))
 		{
-			if (l[i] == '\\')
+			st.inccomment = false;
+		}
+	}
+}
+
+//  =========================================================================
+/// Highlights a single line.
+/// \param lines Cursor positioned at the line.
+/// \param st The lexer state, updated.
+/// \param into Output string, the line and a newline are appended.
+//  =========================================================================
+void grace2htmlApp::highlightline (const linecursor &lines, lexstate &st,
+								   string &into)
+{
+	bool incppcomment = false;
+	string l;
+	string out;
+	
+	htmlescape::escape (l, lines.line(), lines.length(),
+						htmlescape::ltgt | htmlescape::amp | htmlescape::tabs);
+	
+	for (int i=0; i<l.strlen(); ++i)
+	{
+		if (l[i] == '\\')
+		{
+			out.strcat (l[i++]);
+			out.strcat (l[i]);
+		}
+		else
+		{
+			if ((l[i] == '\"') && (! st.insingle) && (! st.inccomment) &&
+				(! incppcomment))
 			{
-				out.strcat (l[i++]);
-				out.strcat (l[i]);
+				st.indouble = !st.indouble;
+				if (st.indouble)
+				{
+					out.strcat ("<span class=\"string\">\"");
+				}
+				else
+				{
+					out.strcat ("\"</span>");
+				}
 			}
-			else
+			else if ((l[i] == '\'') && (! st.indouble) && (! st.inccomment) &&
+				     (! incppcomment))
 			{
-				if ((l[i] == '\"') && (! insingle) && (! inccomment) &&
-					(! incppcomment))
+				st.insingle = !st.insingle;
+				if (st.insingle)
 				{
-					indouble = !indouble;
-					if (indouble)
-					{
-						out.strcat ("<span class=\"string\">\"");
-					}
-					else
-					{
-						out.strcat ("\"</span>");
-					}
+					out.strcat ("<span class=\"string\">'");
 				}
-				else if ((l[i] == '\'') && (! indouble) && (! inccomment) &&
-					     (! incppcomment))
+				else
 				{
-					insingle = !insingle;
-					if (insingle)
-					{
-						out.strcat ("<span class=\"string\">'");
-					}
-					else
-					{
-						out.strcat ("'</span>");
-					}
+					out.strcat ("'</span>");
 				}
-				else if ((l[i] == '#') && (! incppcomment) &&
-						 (! insingle) && (! indouble))
+			}
+			else if ((l[i] == '#') && (! incppcomment) &&
+					 (! st.insingle) && (! st.indouble))
+			{
+				out.strcat ("<span class=\"pre\">#");
+				incppcomment = true;
+			}
+			else if ((l[i] == '/') && (! incppcomment) &&
+					 (! st.inccomment) && (! st.insingle) && (! st.indouble))
+			{
+				if (l[i+1] == '/')
 				{
-					out.strcat ("<span class=\"pre\">#");
 					incppcomment = true;
+					out.strcat ("<span class=\"comment\">//");
+					++i;
 				}
-				else if ((l[i] == '/') && (! incppcomment) &&
-						 (! inccomment) && (! insingle) && (! indouble))
+				else if (l[i+1] == '*')
 				{
-					if (l[i+1] == '/')
-					{
-						incppcomment = true;
-						out.strcat ("<span class=\"comment\">//");
-						++i;
-					}
-					else if (l[i+1] == '*')
-					{
-						inccomment = true;
-						out.strcat ("<span class=\"comment\">/*");
-						++i;
-					}
-					else
-					{
-						out.strcat (l[i]);
-					}
+					st.inccomment = true;
+					out.strcat ("<span class=\"comment\">/*");
+					++i;
 				}
-				else if (inccomment && (l[i] == '*') &&
-						 (l[i+1] == '/'))
+				else
 				{
-					out.strcat ("*/</span>");
-					inccomment = false;
+					out.strcat (l[i]);
 				}
-				else if ((! insingle) && (! indouble)  && (! inccomment) &&
-						 (! incppcomment))
+			}
+			else if (st.inccomment && (l[i] == '*') &&
+					 (l[i+1] == '/'))
+			{
+				out.strcat ("*/</span>");
+				st.inccomment = false;
+			}
+			else if ((! st.insingle) && (! st.indouble)  && (! st.inccomment) &&
+					 (! incppcomment))
+			{
+				char oc = i ? l[i-1] : 0;
+				if ((! isalpha (oc)) && (! isdigit (oc)) &&
+					(oc != '_') && (oc != '$'))
 				{
-					char oc = i ? l[i-1] : 0;
-					if ((! isalpha (oc)) && (! isdigit (oc)) &&
-						(oc != '_') && (oc != '$'))
+					int j;
+					string kwmatch = l.mid (i, 20);
+					for (j=0; j<kwmatch.strlen(); ++j)
+					{
+						char c = kwmatch[j];
+						if ((! isalpha (c)) &&
+							(! isdigit (c)) &&
+							(c != '$') && (c != '_') &&
+							(c != '%')) break;
+					}
+					if (j<20) kwmatch.crop (j);
+					
+					if (kwdb.exists (kwmatch))
 					{
-						int j;
-						string kwmatch = l.mid (i, 20);
-						for (j=0; j<kwmatch.strlen(); ++j)
-						{
-							char c = kwmatch[j];
-							if ((! isalpha (c)) &&
-								(! isdigit (c)) &&
-								(c != '$') && (c != '_') &&
-								(c != '%')) break;
-						}
-						if (j<20) kwmatch.crop (j);
-						
-						if (kwdb.exists (kwmatch))
-						{
-							out.strcat ("<span class=\"keyword\">"
-										"%s</span>" %format (kwmatch));
-							i += kwmatch.strlen() -1;
-						}
-						else
-						{
-							out.strcat (l[i]);
-						}
+						out.strcat ("<span class=\"keyword\">"
+									"%s</span>" %format (kwmatch));
+						i += kwmatch.strlen() -1;
 					}
 					else
 					{
@@ -208,19 +355,18 @@ int grace2htmlApp::main (void)
 					out.strcat (l[i]);
 				}
 			}
+			else
+			{
+				out.strcat (l[i]);
+			}
 		}
-		
-		if (incppcomment)
-		{
-			out.strcat ("</span>");
-			incppcomment = false;
-		}
-		
-		fout.writeln (out);
 	}
 	
-	fout.writeln ("</pre></div>");
+	if (incppcomment)
+	{
+		out.strcat ("</span>");
+	}
 	
-	return 0;
+	into.strcat (out);
+	into.strcat ('\n');
 }
-
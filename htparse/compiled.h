@@ -0,0 +1,134 @@
+#ifndef _htparse_compiled_H
+#define _htparse_compiled_H 1
+#include <grace/value.h>
+#include <grace/str.h>
+#include <string.h>
+
+/// Deepest @loop nesting the compiler accepts.
+#define COMPILED_MAXDEPTH 16
+
+/// A compiled template section.
+typedef void (*compiledsection) (value &env, string &out);
+
+//  -------------------------------------------------------------------------
+/// Entry in the table of compiled sections, which ends with a NULL name.
+//  -------------------------------------------------------------------------
+struct compiledentry
+{
+	const char		*name; ///< The section.
+	compiledsection	 run; ///< Its renderer.
+};
+
+/// Checksum of the template the renderers were generated from.
+extern const char *compiledchecksum;
+
+/// The renderers, generated by htparse --compile (compiled.cpp), or
+/// an empty table for the bootstrap build (nocompiled.cpp). Only the
+/// section memo calls them, for @cache tags it has no output for.
+extern const compiledentry compiledsections[];
+
+//  -------------------------------------------------------------------------
+/// Variable scope used by the generated code. Inside an @loop the
+/// current node's children come before the environment.
+//  -------------------------------------------------------------------------
+class compiledscope
+{
+public:
+					 compiledscope (value &e) : env (e)
+					 {
+					 	depth = 0;
+					 }
+					~compiledscope (void)
+					 {
+					 }
+
+					 /// The value of a $variable$.
+	const string	&var (const char *name)
+					 {
+					 	return lookup (name).sval();
+					 }
+
+					 /// The node an @loop walks over.
+	const value		&collection (const char *name)
+					 {
+					 	return lookup (name);
+					 }
+
+					 /// Execute an @set.
+	void			 set (const char *name, const string &v)
+					 {
+					 	env[name] = v;
+					 }
+
+					 /// Enter an iteration of an @loop.
+	void			 push (const value &node) { nodes[depth++] = &node; }
+
+					 /// Leave it.
+	void			 pop (void) { depth--; }
+
+protected:
+	const value		&lookup (const char *name)
+					 {
+					 	for (int i=depth-1; i>=0; --i)
+					 	{
+					 		if (nodes[i]->exists (name)) return (*nodes[i])[name];
+					 	}
+					 	if (env.exists (name)) return env[name];
+					 	return nothing;
+					 }
+
+	value			&env; ///< The page environment.
+	const value		*nodes[COMPILED_MAXDEPTH]; ///< Current loop nodes.
+	int				 depth; ///< Number of loops entered.
+	value			 nothing; ///< Returned for unknown variables.
+};
+
+//  -------------------------------------------------------------------------
+/// Access to the linked renderers.
+//  -------------------------------------------------------------------------
+class compiledtemplate
+{
+public:
+					 /// Checks if the renderers were made from a
+					 /// template.
+					 /// \param tmpl The template source, as loaded.
+	static bool		 matches (const string &tmpl)
+					 {
+					 	if (! compiledsections[0].name) return false;
+					 	string sum = checksum (tmpl);
+					 	return (sum == compiledchecksum);
+					 }
+
+					 /// The renderer for a section, or NULL.
+	static compiledsection find (const string &name)
+					 {
+					 	for (int i=0; compiledsections[i].name; ++i)
+					 	{
+					 		if (name == compiledsections[i].name)
+					 		{
+					 			return compiledsections[i].run;
+					 		}
+					 	}
+					 	return NULL;
+					 }
+
+					 /// FNV-1a hash of a template, in hex.
+	static string	*checksum (const string &tmpl)
+					 {
+					 	returnclass (string) res retain;
+					 	unsigned long long h = 14695981039346656037ULL;
+					 	const unsigned char *p = (const unsigned char *) tmpl.str();
+					 	for (unsigned int i=0; i<tmpl.strlen(); ++i)
+					 	{
+					 		h ^= p[i];
+					 		h *= 1099511628211ULL;
+					 	}
+					 	for (int i=60; i>=0; i-=4)
+					 	{
+					 		res.strcat ("0123456789abcdef"[(h >> i) & 15]);
+					 	}
+					 	return &res;
+					 }
+};
+
+#endif
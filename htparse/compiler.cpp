@@ -0,0 +1,380 @@
+#include "compiler.h"
+#include "compiled.h"
+#include <ctype.h>
+#include "tagscan.h"
+#include "../common/linecursor.h"
+
+// ==========================================================================
+// CONSTRUCTOR templatecompiler
+// ==========================================================================
+templatecompiler::templatecompiler (void)
+{
+	compiled = skipped = 0;
+}
+
+// ==========================================================================
+// DESTRUCTOR templatecompiler
+// ==========================================================================
+templatecompiler::~templatecompiler (void)
+{
+}
+
+// ==========================================================================
+// METHOD templatecompiler::compile
+// ==========================================================================
+string *templatecompiler::compile (const string &tmpl, const string &srcname)
+{
+	returnclass (string) res retain;
+	value names;
+	value bodies;
+	value seen;
+	bool insection = false;
+
+	linecursor lines (tmpl);
+	while (lines.next())
+	{
+		string ln = lines.str();
+
+		if (ln.left (9) == "@section ")
+		{
+			string name = tagscan::trim (ln.mid (9));
+			names.newval() = name;
+			bodies.newval();
+			seen[name] = seen[name].ival() + 1;
+			insection = true;
+			continue;
+		}
+		if (ln.left (8) == "@define ")
+		{
+			insection = false;
+			continue;
+		}
+		if (! insection) continue;
+
+		// The memo blanks these lines out before the parser sees them.
+		if (ln.left (7) == "@cache ") ln = "";
+		bodies[bodies.count() - 1].newval() = ln;
+	}
+
+	res = "// Generated by htparse --compile from %s, do not edit.\n"
+		  "#include \"compiled.h\"\n\n" %format (srcname);
+	string sum = compiledtemplate::checksum (tmpl);
+	res.strcat ("const char *compiledchecksum = \"%s\";\n\n" %format (sum));
+
+	string table;
+	for (int i=0; i<names.count(); ++i)
+	{
+		string name = names[i];
+		string body, why;
+
+		if (seen[name].ival() > 1) why = "it is defined more than once";
+		else if (! section (bodies[i], body, why)) body.crop ();
+
+		if (why.strlen())
+		{
+			res.strcat ("// @section %s is left to the interpreter: %s.\n\n"
+						%format (name, why));
+			skipped++;
+			continue;
+		}
+
+		res.strcat ("//  ====================================================="
+					"====================\n");
+		res.strcat ("/// @section %s\n" %format (name));
+		res.strcat ("//  ====================================================="
+					"====================\n");
+		res.strcat ("static void section_%i (value &env, string &out)\n"
+					%format (i));
+		res.strcat ("{\n\tcompiledscope S (env);\n");
+		res.strcat (body);
+		res.strcat ("}\n\n");
+
+		string qname = quote (name);
+		table.strcat ("\t{ %s, section_%i },\n" %format (qname, i));
+		compiled++;
+	}
+
+	res.strcat ("extern const compiledentry compiledsections[] =\n{\n");
+	res.strcat (table);
+	res.strcat ("\t{ NULL, NULL }\n};\n");
+	return &res;
+}
+
+// ==========================================================================
+// METHOD templatecompiler::section
+// ==========================================================================
+bool templatecompiler::section (const value &lines, string &into,
+								string &why)
+{
+	value blocks;
+	int depth = 1;
+	int loops = 0;
+
+	foreach (line, lines)
+	{
+		string ln = line.sval();
+		string t = tagscan::trim (ln);
+
+		if ((! t.strlen()) || (t[0] != '@'))
+		{
+			if (ln.strstr ("<<") >= 0)
+			{
+				why = "tags are expanded by the interpreter";
+				return false;
+			}
+			ln.strcat ('\n');
+			if (! text (ln, "out", depth, into, why)) return false;
+			continue;
+		}
+
+		value w = tagscan::words (t);
+		string cmd = w[0];
+		string ind = indent (depth);
+
+		if (cmd == "@set")
+		{
+			// Only @set name = "text".
+			int q = t.strchr ('"');
+			string name = w[1];
+			if ((w.count() < 4) || (w[2] != "=") || (! isname (name)) ||
+				(q < 0) || (t[t.strlen() - 1] != '"') ||
+				(t.strlen() < (unsigned int) (q + 2)))
+			{
+				why = "\"%s\" is not a plain assignment" %format (t);
+				return false;
+			}
+			string lit = t.mid (q+1, t.strlen() - q - 2);
+			if (lit.strchr ('"') >= 0)
+			{
+				why = "\"%s\" is not a plain assignment" %format (t);
+				return false;
+			}
+
+			into.strcat ("%s{\n%s\tstring v;\n" %format (ind, ind));
+			if (! text (lit, "v", depth+1, into, why)) return false;
+			string qname = quote (name);
+			into.strcat ("%s\tS.set (%s, v);\n%s}\n" %format (ind, qname, ind));
+		}
+		else if (cmd == "@loop")
+		{
+			string name = w[1];
+			if ((w.count() != 2) || (! isname (name)))
+			{
+				why = "\"%s\" does not loop over a variable" %format (t);
+				return false;
+			}
+			if (loops == COMPILED_MAXDEPTH)
+			{
+				why = "loops are nested too deep";
+				return false;
+			}
+
+			// The loop runs over a copy, @set changes the environment.
+			into.strcat ("%s{\n" %format (ind));
+			string qname = quote (name);
+			into.strcat ("%s\tvalue L%i = S.collection (%s);\n"
+						 %format (ind, loops, qname));
+			into.strcat ("%s\tfor (int i%i=0; i%i<L%i.count(); ++i%i)\n"
+						 %format (ind, loops, loops, loops, loops));
+			into.strcat ("%s\t{\n" %format (ind));
+			into.strcat ("%s\t\tS.push (L%i[i%i]);\n" %format (ind, loops, loops));
+			blocks.newval() = "loop";
+			loops++;
+			depth += 2;
+		}
+		else if (cmd == "@endloop")
+		{
+			if ((! blocks.count()) || (blocks[blocks.count()-1] != "loop"))
+			{
+				why = "@endloop without @loop";
+				return false;
+			}
+			blocks.rmindex (blocks.count()-1);
+			loops--;
+			depth -= 2;
+			ind = indent (depth);
+			into.strcat ("%s\t\tS.pop ();\n%s\t}\n%s}\n" %format (ind, ind, ind));
+		}
+		else if (cmd == "@if")
+		{
+			// Only @if "text" == "text" and @if "text" != "text".
+			string r = tagscan::trim (t.mid (3));
+			string lhs, op, rhs;
+			int j = -1;
+			if (r.strlen() && (r[0] == '"'))
+			{
+				string after = r.mid (1);
+				j = after.strchr ('"');
+				if (j >= 0) j++;
+			}
+			if (j > 0)
+			{
+				lhs = r.mid (1, j-1);
+				r = tagscan::trim (r.mid (j+1));
+				op = r.left (2);
+				rhs = tagscan::trim (r.mid (2));
+			}
+			if ((j <= 0) || ((op != "==") && (op != "!=")) ||
+				(rhs.strlen() < 2) || (rhs[0] != '"') ||
+				(rhs[rhs.strlen()-1] != '"'))
+			{
+				why = "\"%s\" is not a string comparison" %format (t);
+				return false;
+			}
+			rhs = rhs.mid (1, rhs.strlen()-2);
+			if (rhs.strchr ('"') >= 0)
+			{
+				why = "\"%s\" is not a string comparison" %format (t);
+				return false;
+			}
+
+			into.strcat ("%s{\n%s\tstring lhs, rhs;\n" %format (ind, ind));
+			if (! text (lhs, "lhs", depth+1, into, why)) return false;
+			if (! text (rhs, "rhs", depth+1, into, why)) return false;
+			into.strcat ("%s\tif (lhs %s rhs)\n%s\t{\n" %format (ind, op, ind));
+			blocks.newval() = "if";
+			depth += 2;
+		}
+		else if (cmd == "@endif")
+		{
+			if ((! blocks.count()) || (blocks[blocks.count()-1] != "if"))
+			{
+				why = "@endif without @if";
+				return false;
+			}
+			blocks.rmindex (blocks.count()-1);
+			depth -= 2;
+			ind = indent (depth);
+			into.strcat ("%s\t}\n%s}\n" %format (ind, ind));
+		}
+		else
+		{
+			why = "%s is not supported" %format (cmd);
+			return false;
+		}
+	}
+
+	if (blocks.count())
+	{
+		why = "a block is not closed";
+		return false;
+	}
+	return true;
+}
+
+// ==========================================================================
+// METHOD templatecompiler::text
+// ==========================================================================
+bool templatecompiler::text (const string &txt, const char *target,
+							 int depth, string &into, string &why)
+{
+	string ind = indent (depth);
+	string lit;
+	int sz = txt.strlen();
+	int i = 0;
+
+	while (i < sz)
+	{
+		if (txt[i] != '$')
+		{
+			lit.strcat (txt[i++]);
+			continue;
+		}
+		if (((i+1) < sz) && (txt[i+1] == '$'))
+		{
+			lit.strcat ('$');
+			i += 2;
+			continue;
+		}
+
+		int j = i+1;
+		while ((j < sz) && (isalnum ((unsigned char) txt[j]) || (txt[j] == '_'))) ++j;
+		if ((j >= sz) || (txt[j] != '$') || (j == (i+1)))
+		{
+			why = "a $ that is not a variable";
+			return false;
+		}
+
+		if (lit.strlen())
+		{
+			string qlit = quote (lit);
+			into.strcat ("%s%s.strcat (%s, %i);\n"
+						 %format (ind, target, qlit, lit.strlen()));
+			lit.crop ();
+		}
+		string qname = quote (txt.mid (i+1, j-i-1));
+		into.strcat ("%s%s.strcat (S.var (%s));\n" %format (ind, target, qname));
+		i = j+1;
+	}
+
+	if (lit.strlen())
+	{
+		string qlit = quote (lit);
+		into.strcat ("%s%s.strcat (%s, %i);\n"
+					 %format (ind, target, qlit, lit.strlen()));
+	}
+	return true;
+}
+
+// ==========================================================================
+// METHOD templatecompiler::quote
+// ==========================================================================
+string *templatecompiler::quote (const string &txt)
+{
+	returnclass (string) res retain;
+	res = "\"";
+
+	for (unsigned int i=0; i<txt.strlen(); ++i)
+	{
+		unsigned char c = txt[i];
+		switch (c)
+		{
+			case '\\': res.strcat ("\\\\"); break;
+			case '"': res.strcat ("\\\""); break;
+			case '?': res.strcat ("\\?"); break;
+			case '\n': res.strcat ("\\n"); break;
+			case '\t': res.strcat ("\\t"); break;
+			default:
+				if ((c < 32) || (c > 126))
+				{
+					// Always three digits, so a digit after it can't
+					// become part of the escape.
+					res.strcat ('\\');
+					res.strcat ((char) ('0' + ((c >> 6) & 7)));
+					res.strcat ((char) ('0' + ((c >> 3) & 7)));
+					res.strcat ((char) ('0' + (c & 7)));
+				}
+				else
+				{
+					res.strcat ((char) c);
+				}
+				break;
+		}
+	}
+
+	res.strcat ('"');
+	return &res;
+}
+
+// ==========================================================================
+// METHOD templatecompiler::indent
+// ==========================================================================
+string *templatecompiler::indent (int depth)
+{
+	returnclass (string) res retain;
+	for (int i=0; i<depth; ++i) res.strcat ('\t');
+	return &res;
+}
+
+// ==========================================================================
+// METHOD templatecompiler::isname
+// ==========================================================================
+bool templatecompiler::isname (const string &name)
+{
+	if (! name.strlen()) return false;
+	for (unsigned int i=0; i<name.strlen(); ++i)
+	{
+		if ((! isalnum ((unsigned char) name[i])) && (name[i] != '_')) return false;
+	}
+	return true;
+}
@@ -0,0 +1,62 @@
+#ifndef _htparse_compiler_H
+#define _htparse_compiler_H 1
+#include <grace/value.h>
+#include <grace/str.h>
+
+//  -------------------------------------------------------------------------
+/// Translates the sections of a template into C++ renderers, which
+/// htparse links in as compiled.cpp. They are only reached through the
+/// section memo: a renderer runs when an @cache tag misses, every other
+/// tag still goes through the script parser. Text lines become appends of
+/// their literal parts and variable lookups, @set, @loop and @if
+/// become plain statements. A section using anything else (a tag,
+/// @set with an operator, an expression the compiler doesn't know) is
+/// left out and keeps being rendered by the script parser. The output
+/// carries a checksum of the template, so renderers made from another
+/// version of it are never used.
+//  -------------------------------------------------------------------------
+class templatecompiler
+{
+public:
+					 templatecompiler (void);
+					~templatecompiler (void);
+
+					 /// Generate the renderers for a template.
+					 /// \param tmpl The template source.
+					 /// \param srcname File name, for the header comment.
+					 /// \return The C++ source.
+	string			*compile (const string &tmpl, const string &srcname);
+
+	int				 compiled; ///< Sections turned into code.
+	int				 skipped; ///< Sections left to the interpreter.
+
+protected:
+					 /// Generate the body of a section's renderer.
+					 /// \param lines The section's source lines.
+					 /// \param into String to append the code to.
+					 /// \param why Receives the reason on failure.
+					 /// \return False if the section can't be compiled.
+	bool			 section (const value &lines, string &into,
+							  string &why);
+
+					 /// Generate code that appends text with $variables$
+					 /// to a string.
+					 /// \param txt The text.
+					 /// \param target Name of the string in the code.
+					 /// \param depth Indentation.
+					 /// \param into String to append the code to.
+					 /// \param why Receives the reason on failure.
+	bool			 text (const string &txt, const char *target,
+						   int depth, string &into, string &why);
+
+					 /// A C++ string literal for a text.
+	static string	*quote (const string &txt);
+
+					 /// A number of tabs.
+	static string	*indent (int depth);
+
+					 /// Checks if a word can be a variable name.
+	static bool		 isname (const string &name);
+};
+
+#endif
@@ -1,6 +1,10 @@
 #ifndef _htparse_H
 #define _htparse_H 1
 #include <grace/application.h>
+#include "profiler.h"
+#include "memo.h"
+#include "compiler.h"
+#include "pagearena.h"
 
 //  -------------------------------------------------------------------------
 /// Main application class.
@@ -12,22 +16,119 @@ public:
 				application ("nl.madscience.tools.htparse")
 			 {
 			 	opt = $("-x", $("long", "--xml")) ->
+			 		  $("-b", $("long", "--shox")) ->
 			 		  $("-i", $("long", "--include")) ->
+			 		  $("-a", $("long", "--assets")) ->
+			 		  $("-B", $("long", "--batch")) ->
+			 		  $("-s", $("long", "--stats")) ->
+			 		  $("-n", $("long", "--bench")) ->
+			 		  $("-p", $("long", "--profile")) ->
+			 		  $("-M", $("long", "--no-memo")) ->
+			 		  $("-C", $("long", "--compile")) ->
 			 		  $("-h", $("long", "--help")) ->
 			 		  $("--xml",
 			 		  		$("argc", 1) ->
 			 		  		$("help", "Load environment from XML file")
 			 		   ) ->
+			 		  $("--shox",
+			 		  		$("argc", 1) ->
+			 		  		$("help", "Load environment from binary SHoX file")
+			 		   ) ->
 			 		  $("--include",
 			 		  		$("argc", 1) ->
 			 		  		$("help", "Template file to include")
+			 		   ) ->
+			 		  $("--assets",
+			 		  		$("argc", 1) ->
+			 		  		$("help", "Load fingerprinted asset names from XML file")
+			 		   ) ->
+			 		  $("--batch",
+			 		  		$("argc", 1) ->
+			 		  		$("help", "Render the pages in a list of source/output pairs")
+			 		   ) ->
+			 		  $("--stats",
+			 		  		$("argc", 0) ->
+			 		  		$("help", "Print arena counters and peak RSS")
+			 		   ) ->
+			 		  $("--bench",
+			 		  		$("argc", 1) ->
+			 		  		$("help", "Render the page this many times with a "
+			 		  				  "fresh environment and no memo, then as "
+			 		  				  "many reusing them, print time and "
+			 		  				  "memory use along the way")
+			 		   ) ->
+			 		  $("--profile",
+			 		  		$("argc", 1) ->
+			 		  		$("help", "Profile the templates into this file, "
+			 		  				  "starting it fresh, and print the result")
+			 		   ) ->
+			 		  $("--profile-out",
+			 		  		$("argc", 1) ->
+			 		  		$("help", "Add the profile to a file shared by "
+			 		  				  "a site build, without printing it")
+			 		   ) ->
+			 		  $("--profile-report",
+			 		  		$("argc", 1) ->
+			 		  		$("help", "Print the profile collected in a file")
+			 		   ) ->
+			 		  $("--no-memo",
+			 		  		$("argc", 0) ->
+			 		  		$("help", "Ignore @cache, render every section live")
+			 		   ) ->
+			 		  $("--compile",
+			 		  		$("argc", 1) ->
+			 		  		$("help", "Write C++ renderers for a template to stdout")
+			 		   ) ->
+			 		  $("--no-compiled",
+			 		  		$("argc", 0) ->
+			 		  		$("help", "Render @cache misses with the interpreter only")
+			 		   ) ->
+			 		  $("--check-compiled",
+			 		  		$("argc", 1) ->
+			 		  		$("help", "Render @cache misses compiled and interpreted, "
+			 		  				  "add the comparison to this file")
 			 		   );
+			 	envready = freshenv = false;
+			 	usememo = true;
 			 }
 			~htparseApp (void)
 			 {
 			 }
 
 	int		 main (void);
+	int		 batch (const value &senv, const string &tmpl,
+					const string &listfile);
+	void	 render (const value &senv, const string &tmpl,
+					 const string &scriptfile, string &into);
+	void	 bench (const value &senv, const string &tmpl,
+					const string &scriptfile, int count);
+	void	 benchrun (const char *mode, const value &senv,
+					   const string &tmpl, const string &scriptfile,
+					   int count, string &last, double &ms,
+					   double &allocs);
+	void	 renderpage (value &senv, const string &scriptfile,
+						 string &into);
+	void	 resetenv (const value &env);
+	void	 marktouched (const string &script);
+	void	 indextoc (const value &senv);
+	void	 pagetoc (value &senv, const string &pagefile);
+	void	 printstats (void);
+
+protected:
+	value	 assetmap; ///< Quoted asset names to fingerprinted names.
+	value	 lazy; ///< Lazy environment subtrees decoded so far.
+	value	 tocindex; ///< Headings, chapter, prev and next by page.
+	bool	 profiling; ///< True if pages are profiled.
+	int		 tmpllines; ///< Number of lines in the template.
+	templateprofiler prof; ///< Profile of the rendered pages.
+	sectionmemo memo; ///< Cached output of pure sections.
+	pagearena arena; ///< Scratch memory of the page being rendered.
+	value	 pageenv; ///< Environment reused from page to page.
+	value	 touched; ///< Variables of pageenv the last page may have set.
+	bool	 envready; ///< True once pageenv holds the base environment.
+	bool	 freshenv; ///< True to copy the environment for every page.
+	bool	 usememo; ///< False to parse every page without the memo.
+	string	 pagescript; ///< Template and page source, reused.
 };
 
 #endif
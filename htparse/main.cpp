@@ -1,6 +1,15 @@
 #include "htparse.h"
 #include <grace/scriptparser.h>
 #include <grace/filesystem.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "newcount.h"
+#include "tagscan.h"
+#include "scriptlines.h"
+#include "../common/linecursor.h"
 
 APPOBJECT(htparseApp);
 
@@ -9,16 +18,39 @@ APPOBJECT(htparseApp);
 //  =========================================================================
 int htparseApp::main (void)
 {
+	if (argv.exists ("--profile-report"))
+	{
+		value res;
+		res.loadxml (argv["--profile-report"]);
+		templateprofiler::report (res);
+		return 0;
+	}
+	
+	if (argv.exists ("--compile"))
+	{
+		templatecompiler C;
+		string src = C.compile (fs.load (argv["--compile"]), argv["--compile"]);
+		fout.puts (src);
+		ferr.writeln ("%i sections compiled, %i left to the interpreter"
+					  %format (C.compiled, C.skipped));
+		return 0;
+	}
+	
 	string scriptfile = argv["*"][0];
-	if (! scriptfile) return 1;
+	if ((! scriptfile) && (! argv.exists ("--batch"))) return 1;
+	if ((! scriptfile) && argv.exists ("--bench")) return 1;
 	
 	value senv;
 	if (argv.exists ("--xml"))
 	{
 		senv.loadxml (argv["--xml"]);
 	}
+	else if (argv.exists ("--shox"))
+	{
+		senv.loadshox (argv["--shox"]);
+	}
 	
-	argv["*"].rmindex (0);
+	if (scriptfile) argv["*"].rmindex (0);
 	foreach (arg, argv["*"])
 	{
 		string name, val;
@@ -30,6 +62,19 @@ int htparseApp::main (void)
 	string script;
 	if (argv.exists ("--include"))
 		script = fs.load (argv["--include"]);
+	
+	// The @cache lines are blanked out even if they're not used.
+	script = memo.settemplate (script);
+	memo.setcompiled (! argv.exists ("--no-compiled"),
+					  argv.exists ("--check-compiled"));
+	
+	tmpllines = 0;
+	for (unsigned int i=0; i<script.strlen(); ++i)
+	{
+		if (script[i] == '\n') tmpllines++;
+	}
+	profiling = argv.exists ("--profile") || argv.exists ("--profile-out");
+	usememo = (! argv.exists ("--no-memo"));
 		
 	argv["*"].rmindex (0);
 	foreach (varset, argv["*"])
@@ -38,17 +83,446 @@ int htparseApp::main (void)
 		string var = val.cutat ('=');
 		senv[var] = val;
 	}
-	senv["_file"] = scriptfile;
+	
+	// The toc lookups are the same for every page of a batch.
+	indextoc (senv);
+	
+	// Point quoted asset references at their fingerprinted names.
+	if (argv.exists ("--assets"))
+	{
+		value assets;
+		assets.loadxml (argv["--assets"]);
+		foreach (asset, assets)
+		{
+			assetmap["\"%s\"" %format (asset.id())] = "\"%s\"" %format (asset);
+		}
+	}
+	
+	int res = 0;
+	if (argv.exists ("--batch"))
+	{
+		res = batch (senv, script, argv["--batch"]);
+	}
+	else if (argv.exists ("--bench"))
+	{
+		bench (senv, script, scriptfile, argv["--bench"].ival());
+	}
+	else
+	{
+		string buffer;
+		render (senv, script, scriptfile, buffer);
+		fout.puts (buffer);
+	}
+	
+	if (argv.exists ("--stats")) printstats ();
+	if (argv.exists ("--profile"))
+	{
+		fs.rm (argv["--profile"]);
+		prof.aggregate (argv["--profile"]);
+		prof.report ();
+	}
+	if (argv.exists ("--profile-out")) prof.aggregate (argv["--profile-out"]);
+	if (argv.exists ("--check-compiled"))
+	{
+		memo.savechecks (argv["--check-compiled"]);
+	}
+	return res;
+}
 
-	script.strcat (fs.load (scriptfile));
+//  =========================================================================
+/// Renders a list of pages in one process. Every line of the list holds
+/// a page source and the file to write its output to, separated by a
+/// space. The environment and template are loaded once. The page
+/// environment, the arena and the section memo carry over from one page
+/// to the next.
+/// \param senv The base environment.
+/// \param tmpl The template to prepend to every page.
+/// \param listfile The list of pages.
+/// \return 0 on success, 1 if a page could not be written.
+//  =========================================================================
+int htparseApp::batch (const value &senv, const string &tmpl,
+					   const string &listfile)
+{
+	string list = fs.load (listfile);
+	linecursor lines (list);
+	string buffer;
+	
+	while (lines.next())
+	{
+		string outfile = lines.str();
+		string srcfile = outfile.cutat (' ');
+		if ((! srcfile) || (! outfile)) continue;
+		
+		buffer.crop ();
+		render (senv, tmpl, srcfile, buffer);
+		if (! fs.save (outfile, buffer))
+		{
+			ferr.writeln ("%% Could not write %s" %format (outfile));
+			return 1;
+		}
+	}
+	
+	return 0;
+}
+
+//  =========================================================================
+/// Renders a single page.
+/// \param env The base environment.
+/// \param tmpl The template to prepend to the page.
+/// \param scriptfile The page source.
+/// \param into String to append the output to.
+//  =========================================================================
+void htparseApp::render (const value &env, const string &tmpl,
+						 const string &scriptfile, string &into)
+{
+	pagescript.crop ();
+	pagescript.strcat (tmpl);
+	pagescript.strcat (fs.load (scriptfile));
+	
+	if (freshenv)
+	{
+		value senv = env;
+		renderpage (senv, scriptfile, into);
+	}
+	else
+	{
+		resetenv (env);
+		marktouched (pagescript);
+		renderpage (pageenv, scriptfile, into);
+	}
+	
+	if (assetmap.count()) into.replace (assetmap);
+	arena.reset ();
+}
+
+//  =========================================================================
+/// Renders the page in pagescript.
+/// \param senv The page's environment.
+/// \param scriptfile The page source, for the toc and the profile.
+/// \param into String to append the output to.
+//  =========================================================================
+void htparseApp::renderpage (value &senv, const string &scriptfile,
+							 string &into)
+{
+	const string &script = pagescript;
+	senv["_file"] = scriptfile;
+	pagetoc (senv, scriptfile);
+	
+	// Subtrees split off from a binary environment are only decoded
+	// when the script loops over or refers to them. Once decoded they
+	// are kept for the next pages of a batch.
+	foreach (subtree, senv["_lazy"])
+	{
+		if ((script.strstr ("@loop %s" %format (subtree.id())) >= 0) ||
+			(script.strstr ("$%s" %format (subtree.id())) >= 0))
+		{
+			if (! lazy.exists (subtree.id()))
+			{
+				lazy[subtree.id()].loadshox (subtree.sval());
+			}
+			senv[subtree.id()] = lazy[subtree.id()];
+			touched[subtree.id()] = true;
+		}
+	}
+	senv.rmval ("_lazy");
+	
+	// Profiling runs the sections on their own, before the real run
+	// changes the environment.
+	if (profiling)
+	{
+		prof.profile (script, senv, argv["--include"], tmpllines,
+					  scriptfile);
+	}
 	
 	scriptparser P;
-	P.build (script);
+	if (! usememo) P.build (script);
+	else P.build (memo.expand (script, senv, arena));
+	P.run (senv, into, "main");
+}
+
+//  =========================================================================
+/// Puts back the variables the last page may have changed, so the next
+/// page starts from the base environment without copying all of it.
+/// The first call makes the copy.
+/// \param env The base environment.
+//  =========================================================================
+void htparseApp::resetenv (const value &env)
+{
+	if (! envready)
+	{
+		pageenv = env;
+		envready = true;
+		touched.clear ();
+		return;
+	}
+	
+	foreach (var, touched)
+	{
+		if (env.exists (var.id())) pageenv[var.id()] = env[var.id()];
+		else pageenv.rmval (var.id());
+	}
+	touched.clear ();
+}
+
+//  =========================================================================
+/// Notes the variables rendering a script can change in its environment:
+/// the ones render() sets, those of every @set and the attributes of
+/// every tag, which the parser copies into the environment.
+/// \param script The template and page source.
+//  =========================================================================
+void htparseApp::marktouched (const string &script)
+{
+	touched["_file"] = true;
+	touched["_lazy"] = true;
+	touched["pagetoc"] = true;
+	touched["chapterno"] = true;
+	touched["prev"] = true;
+	touched["next"] = true;
+	
+	scriptlines lines (arena, script);
+	for (int i=0; i<lines.count; ++i)
+	{
+		const scriptline &l = lines[i];
+		
+		if (l.stmtstarts ("@set "))
+		{
+			int j = 5;
+			while ((j < l.stmtlen) &&
+				   ((l.stmt[j] == ' ') || (l.stmt[j] == '\t'))) ++j;
+			int st = j;
+			while ((j < l.stmtlen) && (l.stmt[j] != ' ') &&
+				   (l.stmt[j] != '\t') && (l.stmt[j] != '.') &&
+				   (l.stmt[j] != '[') && (l.stmt[j] != '=')) ++j;
+			if (j > st)
+			{
+				string var;
+				var.strcat (l.stmt + st, j - st);
+				touched[var] = true;
+			}
+		}
+		else if (l.hastag())
+		{
+			string ln;
+			ln.strcat (l.text, l.len);
+			templatetag tag;
+			int pos = 0;
+			while (tagscan::find (ln, pos, tag))
+			{
+				foreach (attr, tag.attr) touched[attr.id()] = true;
+				pos = tag.end;
+			}
+		}
+	}
+}
+
+//  =========================================================================
+/// Bytes currently allocated from the heap.
+//  =========================================================================
+static size_t heapbytes (void)
+{
+#if defined (__GLIBC__) && ((__GLIBC__ > 2) || (__GLIBC_MINOR__ >= 33))
+	struct mallinfo2 mi = mallinfo2 ();
+#else
+	struct mallinfo mi = mallinfo ();
+#endif
+	return (size_t) mi.uordblks + (size_t) mi.hblkhd;
+}
+
+//  =========================================================================
+/// Current resident set size in KB, or the peak where /proc is missing.
+//  =========================================================================
+static long residentkb (void)
+{
+	long pages = 0;
+	long rss = 0;
+	FILE *f = fopen ("/proc/self/statm", "r");
+	if (f)
+	{
+		if (fscanf (f, "%ld %ld", &pages, &rss) != 2) rss = 0;
+		fclose (f);
+	}
+	if (rss) return (rss * sysconf (_SC_PAGESIZE)) / 1024;
+	
+	struct rusage ru;
+	getrusage (RUSAGE_SELF, &ru);
+	return ru.ru_maxrss;
+}
+
+//  =========================================================================
+/// Renders a page a number of times the way htparse did before page
+/// state was reused, with a copy of the environment and no memo for
+/// every page, then as many times reusing them, and compares the two.
+/// Allocations are only counted by the htparse-bench build.
+/// \param senv The base environment.
+/// \param tmpl The template to prepend to the page.
+/// \param scriptfile The page source.
+/// \param count Number of renders of each kind.
+//  =========================================================================
+void htparseApp::bench (const value &senv, const string &tmpl,
+						const string &scriptfile, int count)
+{
+	string fresh, reused;
+	double freshms, reusedms, freshnew, reusednew;
+	
+	freshenv = true;
+	usememo = false;
+	benchrun ("fresh", senv, tmpl, scriptfile, count, fresh, freshms,
+			  freshnew);
 	
+	freshenv = false;
+	usememo = (! argv.exists ("--no-memo"));
+	benchrun ("reused", senv, tmpl, scriptfile, count, reused, reusedms,
+			  reusednew);
+	
+	if (reused != fresh)
+	{
+		ferr.writeln ("% Reusing page state changes the output");
+	}
+	
+	string allocs = "-";
+	if (newcount::counting ())
+	{
+		allocs = "%.1f -> %.1f" %format (freshnew, reusednew);
+	}
+	fout.writeln ("fresh -> reused: %.3f -> %.3f ms/render, %s new/render"
+				  %format (freshms, reusedms, allocs));
+}
+
+//  =========================================================================
+/// Renders a page a number of times and prints, at every tenth of the
+/// run, the time and allocations per render and the memory in use. Heap
+/// and RSS should level off after the first pages.
+/// \param mode Name of the configuration, for the report.
+/// \param senv The base environment.
+/// \param tmpl The template to prepend to the page.
+/// \param scriptfile The page source.
+/// \param count Number of renders.
+/// \param last Receives the output of the last render.
+/// \param ms Receives the time per render over the whole run.
+/// \param allocs Receives the allocations per render.
+//  =========================================================================
+void htparseApp::benchrun (const char *mode, const value &senv,
+						   const string &tmpl, const string &scriptfile,
+						   int count, string &last, double &ms,
+						   double &allocs)
+{
+	if (count < 10) count = 10;
+	int step = count / 10;
 	string buffer;
-	P.run (senv, buffer, "main");
+	struct timeval tv;
+	double total = 0.0;
+	unsigned long long totalcalls = 0;
 	
-	fout.puts (buffer);
-	return 0;
+	for (int done=0; done<count; done+=step)
+	{
+		unsigned long long calls = newcount::calls ();
+		gettimeofday (&tv, NULL);
+		double tstart = tv.tv_sec + (tv.tv_usec / 1000000.0);
+		
+		for (int i=0; i<step; ++i)
+		{
+			buffer.crop ();
+			render (senv, tmpl, scriptfile, buffer);
+		}
+		
+		gettimeofday (&tv, NULL);
+		double t = (tv.tv_sec + (tv.tv_usec / 1000000.0)) - tstart;
+		calls = newcount::calls () - calls;
+		total += t;
+		totalcalls += calls;
+		
+		string perpage = "-";
+		if (newcount::counting ())
+		{
+			perpage = "%.1f" %format ((double) calls / step);
+		}
+		
+		fout.writeln ("%s %i renders: %.3f ms/render, %s new/render, "
+					  "%i KB heap, %i KB rss"
+					  %format (mode, done + step, (t * 1000.0) / step,
+					  		   perpage, (int) (heapbytes () / 1024),
+					  		   (int) residentkb ()));
+	}
+	
+	int renders = ((count + step - 1) / step) * step;
+	last = buffer;
+	ms = (total * 1000.0) / renders;
+	allocs = (double) totalcalls / renders;
 }
 
+//  =========================================================================
+/// Prints the arena counters and peak memory use to stderr.
+//  =========================================================================
+void htparseApp::printstats (void)
+{
+	arenastats st;
+	arena.getstats (st);
+	
+	struct rusage ru;
+	getrusage (RUSAGE_SELF, &ru);
+	
+	ferr.writeln ("%i pages, %i arena blocks, %i KB at most per page, "
+				  "%i chunks taken, %i given back; %i KB max rss"
+				  %format ((int) st.pages, (int) st.allocs,
+				  		   (int) ((st.peak + 1023) / 1024), (int) st.chunks,
+				  		   (int) st.freed, (int) ru.ru_maxrss));
+	ferr.writeln ("%i section outputs reused, %i rendered, %i by compiled "
+				  "code" %format (memo.hits, memo.misses, memo.compiledruns));
+}
+
+
+//  =========================================================================
+/// Precomputes the table of contents lookups for all pages, so the
+/// template doesn't have to scan the full toc for every page. Done once
+/// per process; pagetoc() looks up the page being rendered.
+/// \param senv The script environment, with the toc loaded.
+//  =========================================================================
+void htparseApp::indextoc (const value &senv)
+{
+	string prevfile;
+	int chapterno = 0;
+	
+	tocindex.clear ();
+	foreach (doc, senv["wwgdocs"])
+	{
+		const string &docfile = doc["filename"];
+		value &ent = tocindex[docfile];
+		ent["headings"] = doc["headings"];
+		ent["chapterno"] = ++chapterno;
+		ent["prev"] = prevfile;
+		ent["next"] = "";
+		if (prevfile) tocindex[prevfile]["next"] = docfile;
+		prevfile = docfile;
+	}
+	
+	foreach (doc, senv["otherpages"])
+	{
+		tocindex[doc["filename"].sval()]["headings"] = doc["headings"];
+	}
+}
+
+//  =========================================================================
+/// Sets the toc lookups for the page being rendered: pagetoc (the page's
+/// headings), chapterno, prev and next.
+/// \param senv The page's environment.
+/// \param pagefile The page source, optionally ending in .tmphtml.
+//  =========================================================================
+void htparseApp::pagetoc (value &senv, const string &pagefile)
+{
+	string fname = pagefile;
+	if (fname.strlen() > 8 && fname.mid (fname.strlen() - 8) == ".tmphtml")
+	{
+		fname.crop (fname.strlen() - 8);
+	}
+	
+	if (! tocindex.exists (fname)) return;
+	
+	const value &ent = tocindex[fname];
+	senv["pagetoc"] = ent["headings"];
+	if (ent.exists ("chapterno"))
+	{
+		senv["chapterno"] = ent["chapterno"];
+		senv["prev"] = ent["prev"];
+		senv["next"] = ent["next"];
+	}
+}
@@ -0,0 +1,423 @@
+#include "memo.h"
+#include "tagscan.h"
+#include "scriptlines.h"
+#include <grace/application.h>
+#include <grace/filesystem.h>
+#include "../common/linecursor.h"
+#include "../common/filelock.h"
+
+//  =========================================================================
+/// Checks if section output can be pasted into template source without
+/// the parser reading anything in it as a statement or a tag.
+//  =========================================================================
+static bool splicable (const string &html)
+{
+	if (html.strstr ("<<") >= 0) return false;
+
+	linecursor lines (html);
+	while (lines.next())
+	{
+		string t = tagscan::trim (lines.str());
+		if (t.strlen() && (t[0] == '@')) return false;
+	}
+	return true;
+}
+
+// ==========================================================================
+// CONSTRUCTOR sectionmemo
+// ==========================================================================
+sectionmemo::sectionmemo (void)
+{
+	hits = misses = compiledruns = 0;
+	usecompiled = true;
+	checking = false;
+	stale = true;
+}
+
+// ==========================================================================
+// DESTRUCTOR sectionmemo
+// ==========================================================================
+sectionmemo::~sectionmemo (void)
+{
+}
+
+// ==========================================================================
+// METHOD sectionmemo::settemplate
+// ==========================================================================
+string *sectionmemo::settemplate (const string &tmpl)
+{
+	returnclass (string) res retain;
+	string cur;
+
+	setsby.clear ();
+	calls.clear ();
+
+	stale = (! compiledtemplate::matches (tmpl));
+
+	linecursor lines (tmpl);
+	while (lines.next())
+	{
+		string ln = lines.str();
+
+		if (ln.left (7) == "@cache ")
+		{
+			value w = tagscan::words (ln.mid (7));
+			if (w.count())
+			{
+				value &d = decl[w[0].sval()];
+				d["vars"].clear ();
+				for (int i=1; i<w.count(); ++i) d["vars"].newval() = w[i];
+			}
+			res.strcat ('\n');
+			continue;
+		}
+
+		res.strcat (ln);
+		res.strcat ('\n');
+
+		if (ln.left (9) == "@section ")
+		{
+			cur = tagscan::trim (ln.mid (9));
+			continue;
+		}
+		if (ln.left (8) == "@define ")
+		{
+			cur = "";
+			continue;
+		}
+		if (! cur) continue;
+
+		// Every variable the section sets, at any depth, gets replayed
+		// with the value it ended up with.
+		string t = tagscan::trim (ln);
+		if (t.left (5) == "@set ")
+		{
+			value w = tagscan::words (t);
+			if (w.count() >= 2) setsby[cur][w[1].sval()] = true;
+		}
+		else if (ln.strstr ("<<") >= 0)
+		{
+			templatetag tag;
+			int pos = 0;
+			while (tagscan::find (ln, pos, tag))
+			{
+				if (tag.name.strlen() && (tag.name[0] != '/'))
+				{
+					calls[cur][tag.name] = true;
+				}
+				pos = tag.end;
+			}
+		}
+	}
+
+	foreach (d, decl)
+	{
+		d["sets"].clear ();
+		if (! setsby.exists (d.id())) continue;
+		foreach (v, setsby[d.id()]) d["sets"].newval() = v.id();
+	}
+	if (decl.count()) tmplparser.build (res);
+	return &res;
+}
+
+// ==========================================================================
+// METHOD sectionmemo::expand
+// ==========================================================================
+string *sectionmemo::expand (const string &script, const value &senv,
+							 pagearena &arena)
+{
+	returnclass (string) res retain;
+	if (! decl.count())
+	{
+		res = script;
+		return &res;
+	}
+
+	value assigned;
+	bool inmain = false;
+	int depth = 0;
+
+	// Only lines with a tag to splice and the odd @section or @set are
+	// copied into strings, the rest goes from the script to the result.
+	scriptlines lines (arena, script);
+	for (int i=0; i<lines.count; ++i)
+	{
+		const scriptline &l = lines[i];
+
+		if (l.starts ("@section "))
+		{
+			string ln;
+			ln.strcat (l.text + 9, l.len - 9);
+			string name = tagscan::trim (ln);
+			inmain = (name == "main");
+		}
+		else if (l.starts ("@define "))
+		{
+			inmain = false;
+		}
+		else if (inmain)
+		{
+			if (l.stmtstarts ("@loop ") || l.stmtstarts ("@if ")) depth++;
+			else if (l.stmtstarts ("@endloop") || l.stmtstarts ("@endif"))
+			{
+				depth--;
+			}
+			else if (l.stmtstarts ("@set "))
+			{
+				int j = 5;
+				while ((j < l.stmtlen) &&
+					   ((l.stmt[j] == ' ') || (l.stmt[j] == '\t'))) ++j;
+				int st = j;
+				while ((j < l.stmtlen) &&
+					   (l.stmt[j] != ' ') && (l.stmt[j] != '\t')) ++j;
+				if (j > st)
+				{
+					string var;
+					var.strcat (l.stmt + st, j - st);
+					assigned[var] = true;
+				}
+			}
+			else if ((! depth) && l.hastag())
+			{
+				string ln;
+				ln.strcat (l.text, l.len);
+				expandline (ln, senv, assigned, res);
+				continue;
+			}
+			else if (l.hastag())
+			{
+				string ln;
+				ln.strcat (l.text, l.len);
+				templatetag tag;
+				int pos = 0;
+				while (tagscan::find (ln, pos, tag))
+				{
+					marktag (tag, assigned);
+					pos = tag.end;
+				}
+			}
+		}
+
+		res.strcat (l.text, l.len);
+		res.strcat ('\n');
+	}
+
+	return &res;
+}
+
+// ==========================================================================
+// METHOD sectionmemo::expandline
+// ==========================================================================
+void sectionmemo::expandline (const string &ln, const value &senv,
+							  value &assigned, string &into)
+{
+	string out, sets;
+	templatetag tag;
+	int pos = 0;
+
+	while (tagscan::find (ln, pos, tag))
+	{
+		out.strcat (ln.mid (pos, tag.start - pos));
+		string tagtext = ln.mid (tag.start, tag.end - tag.start);
+		pos = tag.end;
+
+		bool usable = decl.exists (tag.name);
+		if (usable)
+		{
+			foreach (var, decl[tag.name]["vars"])
+			{
+				if (assigned.exists (var.sval())) usable = false;
+			}
+		}
+
+		// Whatever this tag changes is stale for the tags after it.
+		marktag (tag, assigned);
+
+		if (! usable)
+		{
+			out.strcat (tagtext);
+			continue;
+		}
+
+		value env = senv;
+		foreach (attr, tag.attr) env[attr.id()] = attr;
+
+		string key = tag.name;
+		key.strcat ('\n');
+		key.strcat (tag.attr.tojson());
+		foreach (var, decl[tag.name]["vars"])
+		{
+			key.strcat ('\n');
+			key.strcat (env[var.sval()].tojson());
+		}
+
+		if (! memo.exists (key))
+		{
+			// Variables the section sets that aren't part of the key start
+			// out empty, so the ones it leaves alone can be told apart
+			// from the ones it changed.
+			foreach (var, decl[tag.name]["sets"])
+			{
+				if (tag.attr.exists (var.sval())) continue;
+				if (isdeclared (tag.name, var.sval())) continue;
+				env.rmval (var.sval());
+			}
+
+			string html;
+			rendersection (tag.name, env, html);
+			bool ok = splicable (html);
+			if (ok) html.replace ($("$", "$$"));
+
+			string replay;
+			foreach (var, decl[tag.name]["sets"])
+			{
+				if (! env.exists (var.sval())) continue;
+				string v = env[var.sval()].sval();
+				if ((v.strchr ('"') >= 0) || (v.strchr ('$') >= 0) ||
+					(v.strchr ('\\') >= 0) || (v.strchr ('\n') >= 0))
+				{
+					ok = false;
+					break;
+				}
+				replay.strcat ("@set %s = \"%s\"\n" %format (var.sval(), v));
+			}
+
+			memo[key] = $("ok", ok) -> $("html", html) -> $("sets", replay);
+			misses++;
+		}
+		else
+		{
+			hits++;
+		}
+
+		const value &m = memo[key];
+		if (! m["ok"].bval())
+		{
+			out.strcat (tagtext);
+			continue;
+		}
+
+		out.strcat (m["html"].sval());
+		sets.strcat (m["sets"].sval());
+	}
+
+	out.strcat (ln.mid (pos));
+	into.strcat (sets);
+	into.strcat (out);
+	into.strcat ('\n');
+}
+
+// ==========================================================================
+// METHOD sectionmemo::marktag
+// ==========================================================================
+void sectionmemo::marktag (const templatetag &tag, value &assigned)
+{
+	if ((! tag.name.strlen()) || (tag.name[0] == '/')) return;
+
+	// The parser copies the attributes into the environment.
+	foreach (attr, tag.attr) assigned[attr.id()] = true;
+
+	value seen;
+	marksets (tag.name, assigned, seen);
+}
+
+// ==========================================================================
+// METHOD sectionmemo::marksets
+// ==========================================================================
+void sectionmemo::marksets (const string &name, value &assigned,
+							value &seen)
+{
+	if (seen.exists (name)) return;
+	seen[name] = true;
+
+	if (setsby.exists (name))
+	{
+		foreach (var, setsby[name]) assigned[var.id()] = true;
+	}
+	if (calls.exists (name))
+	{
+		foreach (sec, calls[name]) marksets (sec.id(), assigned, seen);
+	}
+}
+
+// ==========================================================================
+// METHOD sectionmemo::isdeclared
+// ==========================================================================
+bool sectionmemo::isdeclared (const string &name, const string &var)
+{
+	foreach (v, decl[name]["vars"])
+	{
+		if (v.sval() == var) return true;
+	}
+	return false;
+}
+
+// ==========================================================================
+// METHOD sectionmemo::setcompiled
+// ==========================================================================
+void sectionmemo::setcompiled (bool use, bool check)
+{
+	usecompiled = use;
+	checking = check;
+}
+
+// ==========================================================================
+// METHOD sectionmemo::rendersection
+// ==========================================================================
+void sectionmemo::rendersection (const string &name, value &env,
+								 string &into)
+{
+	compiledsection run = NULL;
+	if (usecompiled && (! stale)) run = compiledtemplate::find (name);
+
+	if (! run)
+	{
+		tmplparser.run (env, into, name);
+		return;
+	}
+
+	if (! checking)
+	{
+		run (env, into);
+		compiledruns++;
+		return;
+	}
+
+	value cenv = env;
+	string fast;
+	run (cenv, fast);
+	tmplparser.run (env, into, name);
+
+	value &c = checks[name];
+	if (fast == into)
+	{
+		c["agreed"] = c["agreed"].ival() + 1;
+		return;
+	}
+
+	c["differed"] = c["differed"].ival() + 1;
+	ferr.writeln ("%% Compiled section %s differs from the interpreter"
+				  %format (name));
+}
+
+// ==========================================================================
+// METHOD sectionmemo::savechecks
+// ==========================================================================
+void sectionmemo::savechecks (const string &path)
+{
+	filelock lck ("%s.lock" %format (path));
+	value total;
+	if (fs.exists (path)) total.loadxml (path);
+
+	total["runs"] = total["runs"].ival() + 1;
+	if (stale) total["stale"] = true;
+
+	foreach (c, checks)
+	{
+		value &t = total["sections"][c.id()];
+		t["agreed"] = t["agreed"].ival() + c["agreed"].ival();
+		t["differed"] = t["differed"].ival() + c["differed"].ival();
+	}
+
+	total.savexml (path);
+}
@@ -0,0 +1,121 @@
+#ifndef _htparse_memo_H
+#define _htparse_memo_H 1
+#include <grace/value.h>
+#include <grace/str.h>
+#include <grace/scriptparser.h>
+#include "compiled.h"
+#include "pagearena.h"
+#include "tagscan.h"
+
+//  -------------------------------------------------------------------------
+/// Memoized rendering of pure template sections. The template marks a
+/// section as pure with a line
+///
+///   @cache toc _file
+///
+/// naming the section and the variables its output depends on besides
+/// the tag's own attributes. Before a page is parsed, every tag for
+/// such a section in the page's main section is replaced by the
+/// section's output for those values, rendered once and cached for the
+/// rest of the htparse run. mksite renders all its pages in one run
+/// through --batch, so the cache is shared by the pages of a group.
+///
+/// Every variable the section can @set is put back in front of the
+/// output with a @set of the value it had after the section was first
+/// rendered; a variable the section left alone is not touched. Lines
+/// after the tag see those variables as a live render leaves them.
+/// Variables the section reads before it sets them must be named on
+/// the @cache line. A section that leaves a value a @set can't spell
+/// (quotes, $, backslashes or line breaks) is never spliced.
+///
+/// A tag keeps going through the parser the normal way when it sits
+/// inside an @loop or @if, when one of its variables was changed before
+/// it by a @set of the page or by an earlier tag (a @set in the section
+/// the tag runs, or in a section that runs, or an attribute of the
+/// tag), or when the output itself looks like template source.
+///
+/// On a miss the section is rendered by the compiled renderer linked
+/// into htparse when it was generated from this template, otherwise by
+/// the script parser. This is the only place compiled renderers are
+/// used; sections without @cache are always interpreted.
+//  -------------------------------------------------------------------------
+class sectionmemo
+{
+public:
+					 sectionmemo (void);
+					~sectionmemo (void);
+
+					 /// Read the @cache declarations of a template.
+					 /// \param tmpl The template.
+					 /// \return The template with the declarations
+					 ///         blanked out, so line numbers stay put.
+	string			*settemplate (const string &tmpl);
+
+					 /// Choose how sections are rendered.
+					 /// \param use False to leave it all to the parser.
+					 /// \param check True to render every section both
+					 ///        ways and compare; the parser's output
+					 ///        is used.
+	void			 setcompiled (bool use, bool check);
+
+					 /// Add the comparisons made in check mode to a
+					 /// file shared by the htparse runs of a site build.
+	void			 savechecks (const string &path);
+
+					 /// Splice cached sections into a page.
+					 /// \param script The template followed by the page.
+					 /// \param senv The environment the page renders with.
+					 /// \param arena The page's arena, for scratch data.
+					 /// \return The script to parse.
+	string			*expand (const string &script, const value &senv,
+							 pagearena &arena);
+
+	int				 hits; ///< Tags served from the cache.
+	int				 misses; ///< Tags rendered into the cache.
+	int				 compiledruns; ///< Sections rendered by compiled code.
+
+protected:
+					 /// Splice the cached tags of a line of the page.
+					 /// \param ln The line.
+					 /// \param senv The environment.
+					 /// \param assigned Variables the page has set so far.
+					 /// \param into The script being built.
+	void			 expandline (const string &ln, const value &senv,
+								 value &assigned, string &into);
+
+					 /// Add the variables a tag changes to a set.
+					 /// \param tag The tag.
+					 /// \param assigned The variables.
+	void			 marktag (const templatetag &tag, value &assigned);
+
+					 /// Add the variables a section and the sections
+					 /// it runs can @set to a set.
+					 /// \param name The section.
+					 /// \param assigned The variables.
+					 /// \param seen Sections already added.
+	void			 marksets (const string &name, value &assigned,
+							   value &seen);
+
+					 /// Render a section, compiled if possible.
+					 /// \param name The section.
+					 /// \param env The environment.
+					 /// \param into String to append the output to.
+	void			 rendersection (const string &name, value &env,
+									string &into);
+
+					 /// Checks if a variable is on a section's @cache
+					 /// line.
+	bool			 isdeclared (const string &name, const string &var);
+
+	value			 decl; ///< Variables and variables set, by section.
+	value			 setsby; ///< Variables set by every section.
+	value			 calls; ///< Sections run by the tags of every section.
+	value			 memo; ///< Output and replayed sets by key.
+	scriptparser	 tmplparser; ///< Parser with just the template.
+	bool			 usecompiled; ///< False if compiled code is off.
+	bool			 checking; ///< True to compare both renderings.
+	bool			 stale; ///< True if the renderers don't match.
+	value			 checks; ///< Comparison counts by section.
+};
+
+#endif
@@ -0,0 +1,36 @@
+#include "newcount.h"
+#include <stdlib.h>
+#include <new>
+
+// Counts and passes on to malloc; array and nothrow new end up here
+// through the library's defaults.
+
+static unsigned long long newcalls = 0;
+
+bool newcount::counting (void)
+{
+	return true;
+}
+
+unsigned long long newcount::calls (void)
+{
+	return __atomic_load_n (&newcalls, __ATOMIC_RELAXED);
+}
+
+void *operator new (size_t sz)
+{
+	__atomic_add_fetch (&newcalls, 1, __ATOMIC_RELAXED);
+	void *p = malloc (sz ? sz : 1);
+	if (! p) throw std::bad_alloc ();
+	return p;
+}
+
+void operator delete (void *p) throw ()
+{
+	free (p);
+}
+
+void operator delete (void *p, size_t) throw ()
+{
+	free (p);
+}
@@ -0,0 +1,19 @@
+#ifndef _htparse_newcount_H
+#define _htparse_newcount_H 1
+
+//  -------------------------------------------------------------------------
+/// Counter of calls to operator new, for htparse --bench. Only the
+/// htparse-bench build (newcount.cpp) counts; htparse itself links
+/// nonewcount.cpp and leaves the allocator alone.
+//  -------------------------------------------------------------------------
+class newcount
+{
+public:
+					 /// True if this build counts.
+	static bool		 counting (void);
+
+					 /// Calls to operator new so far.
+	static unsigned long long calls (void);
+};
+
+#endif
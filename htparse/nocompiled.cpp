@@ -0,0 +1,7 @@
+#include "compiled.h"
+
+// Empty table for htparse-boot, the build that generates compiled.cpp.
+
+const char *compiledchecksum = "";
+
+extern const compiledentry compiledsections[] = { { NULL, NULL } };
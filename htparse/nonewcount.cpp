@@ -0,0 +1,13 @@
+#include "newcount.h"
+
+// For htparse and htparse-boot, which don't count allocations.
+
+bool newcount::counting (void)
+{
+	return false;
+}
+
+unsigned long long newcount::calls (void)
+{
+	return 0;
+}
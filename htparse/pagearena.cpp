@@ -0,0 +1,119 @@
+#include "pagearena.h"
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+#define ARENA_ALIGN		16
+#define ARENA_CHUNK		65536
+
+/// Chunk header size, rounded up so the data stays aligned.
+#define ARENA_HDR ((sizeof (arenachunk) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+// ==========================================================================
+// CONSTRUCTOR pagearena
+// ==========================================================================
+pagearena::pagearena (void)
+{
+	first = cur = NULL;
+	used = pagebytes = 0;
+	memset (&counters, 0, sizeof (counters));
+}
+
+// ==========================================================================
+// DESTRUCTOR pagearena
+// ==========================================================================
+pagearena::~pagearena (void)
+{
+	while (first)
+	{
+		arenachunk *c = first;
+		first = c->next;
+		free (c);
+	}
+}
+
+// ==========================================================================
+// METHOD pagearena::alloc
+// ==========================================================================
+void *pagearena::alloc (size_t sz)
+{
+	sz = (sz + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+	if (! sz) sz = ARENA_ALIGN;
+
+	if ((! cur) || ((used + sz) > cur->size))
+	{
+		// Move on to the next chunk kept from an earlier page, or make
+		// one in front of it if the block doesn't fit.
+		arenachunk *next = cur ? cur->next : first;
+		if ((! next) || (next->size < sz))
+		{
+			next = addchunk (sz > ARENA_CHUNK ? sz : ARENA_CHUNK);
+		}
+		cur = next;
+		used = 0;
+	}
+
+	void *res = ((char *) cur) + ARENA_HDR + used;
+	used += sz;
+	pagebytes += sz;
+	counters.allocs++;
+	return res;
+}
+
+// ==========================================================================
+// METHOD pagearena::reset
+// ==========================================================================
+void pagearena::reset (void)
+{
+	counters.pages++;
+	if (pagebytes > counters.peak) counters.peak = pagebytes;
+
+	arenachunk **link = &first;
+	while (*link)
+	{
+		arenachunk *c = *link;
+		if (c->size > ARENA_CHUNK)
+		{
+			*link = c->next;
+			free (c);
+			counters.freed++;
+			continue;
+		}
+		link = &c->next;
+	}
+
+	cur = NULL;
+	used = pagebytes = 0;
+}
+
+// ==========================================================================
+// METHOD pagearena::getstats
+// ==========================================================================
+void pagearena::getstats (arenastats &into) const
+{
+	into = counters;
+	if (pagebytes > into.peak) into.peak = pagebytes;
+}
+
+// ==========================================================================
+// METHOD pagearena::addchunk
+// ==========================================================================
+arenachunk *pagearena::addchunk (size_t sz)
+{
+	arenachunk *c = (arenachunk *) malloc (ARENA_HDR + sz);
+	if (! c) throw std::bad_alloc ();
+	c->size = sz;
+	counters.chunks++;
+
+	if (cur)
+	{
+		c->next = cur->next;
+		cur->next = c;
+	}
+	else
+	{
+		c->next = first;
+		first = c;
+	}
+	return c;
+}
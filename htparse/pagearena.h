@@ -0,0 +1,65 @@
+#ifndef _htparse_pagearena_H
+#define _htparse_pagearena_H 1
+#include <stddef.h>
+
+//  -------------------------------------------------------------------------
+/// Counters of a page arena.
+//  -------------------------------------------------------------------------
+struct arenastats
+{
+	unsigned int	 pages; ///< Resets, one per page rendered.
+	unsigned int	 allocs; ///< Blocks handed out.
+	unsigned int	 chunks; ///< Chunks taken from malloc.
+	unsigned int	 freed; ///< Oversized chunks given back on reset.
+	size_t			 peak; ///< Most bytes used by a single page.
+};
+
+//  -------------------------------------------------------------------------
+/// A chunk of arena memory, followed by its data.
+//  -------------------------------------------------------------------------
+struct arenachunk
+{
+	arenachunk		*next; ///< Next chunk.
+	size_t			 size; ///< Bytes of data.
+};
+
+//  -------------------------------------------------------------------------
+/// Bump allocator for the scratch data htparse builds while it renders
+/// a page. Blocks are carved from 64KB chunks and never freed one by
+/// one: reset() after a page rewinds to the first chunk, so the next
+/// page reuses the same memory without going to malloc. Chunks made
+/// for a single oversized block are given back on reset, so one large
+/// page doesn't pin its memory for the rest of a batch.
+///
+/// An arena belongs to one renderer and isn't locked.
+//  -------------------------------------------------------------------------
+class pagearena
+{
+public:
+						 pagearena (void);
+						~pagearena (void);
+
+						 /// Allocate a block, aligned to 16 bytes.
+						 /// Throws std::bad_alloc if out of memory.
+						 /// \param sz Size in bytes.
+	void				*alloc (size_t sz);
+
+						 /// Release everything allocated since the last
+						 /// reset.
+	void				 reset (void);
+
+						 /// Copy the counters.
+	void				 getstats (arenastats &into) const;
+
+protected:
+						 /// Make a chunk and link it in after cur.
+	arenachunk			*addchunk (size_t sz);
+
+	arenachunk			*first; ///< The chunks, in order of use.
+	arenachunk			*cur; ///< Chunk being carved.
+	size_t				 used; ///< Bytes carved from cur.
+	size_t				 pagebytes; ///< Bytes handed out this page.
+	arenastats			 counters; ///< Counters.
+};
+
+#endif
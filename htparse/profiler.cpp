@@ -0,0 +1,373 @@
+#include "profiler.h"
+#include <grace/application.h>
+#include <grace/filesystem.h>
+#include <sys/time.h>
+#include <stdlib.h>
+#include "../common/linecursor.h"
+#include "../common/filelock.h"
+#include "tagscan.h"
+
+//  =========================================================================
+/// Current time in seconds.
+//  =========================================================================
+static double profnow (void)
+{
+	struct timeval tv;
+	gettimeofday (&tv, NULL);
+	return tv.tv_sec + (tv.tv_usec / 1000000.0);
+}
+
+//  =========================================================================
+/// Appends the lines that close a stack of open blocks.
+//  =========================================================================
+static void closeblocks (string &into, const value &open)
+{
+	for (int i=open.count()-1; i>=0; --i)
+	{
+		into.strcat (open[i]["close"].sval());
+		into.strcat ('\n');
+	}
+}
+
+// ==========================================================================
+// CONSTRUCTOR templateprofiler
+// ==========================================================================
+templateprofiler::templateprofiler (void)
+{
+}
+
+// ==========================================================================
+// DESTRUCTOR templateprofiler
+// ==========================================================================
+templateprofiler::~templateprofiler (void)
+{
+}
+
+// ==========================================================================
+// METHOD templateprofiler::profile
+// ==========================================================================
+void templateprofiler::profile (const string &script, const value &senv,
+								const string &tmplname, int tmpllines,
+								const string &pagename)
+{
+	value lines;
+	linecursor lc (script);
+	while (lc.next()) lines.newval() = lc.str();
+
+	value locations;
+	for (int i=0; i<lines.count(); ++i)
+	{
+		if (i < tmpllines)
+			locations.newval() = "%s:%i" %format (tmplname, i+1);
+		else
+			locations.newval() = "%s:%i" %format (pagename, i-tmpllines+1);
+	}
+
+	// Split the script into sections. Defines live outside of them.
+	value sections;
+	string cur;
+	for (int i=0; i<lines.count(); ++i)
+	{
+		const string &ln = lines[i].sval();
+		if (ln.left (9) == "@section ")
+		{
+			cur = ln.mid (9);
+			cur.chomp ();
+			sections[cur]["head"] = i;
+			continue;
+		}
+		if (ln.left (8) == "@define ")
+		{
+			cur = "";
+			continue;
+		}
+		if (cur) sections[cur]["body"].newval() = i;
+	}
+
+	if (! sections.exists ("main")) return;
+
+	// Every tag in the page is a call to a section. Tags in the sections
+	// called are followed as well, so the time of a section can be told
+	// apart from that of the sections it calls.
+	value calls;
+	calls.newval() = $("section", "main") -> $("parent", -1) -> $("depth", 0);
+	for (int c=0; c<calls.count(); ++c)
+	{
+		string secname = calls[c]["section"];
+		value callenv = calls[c]["env"];
+		int depth = calls[c]["depth"].ival();
+		if (depth >= PROFILE_DEPTH) continue;
+
+		foreach (idx, sections[secname]["body"])
+		{
+			const string &ln = lines[idx.ival()].sval();
+			templatetag tag;
+			int pos = 0;
+			while (tagscan::find (ln, pos, tag))
+			{
+				if (sections.exists (tag.name) &&
+					(calls.count() < PROFILE_MAXCALLS))
+				{
+					value env = callenv;
+					foreach (attr, tag.attr) env[attr.id()] = attr;
+					calls.newval() = $("section", tag.name) ->
+									 $("env", env) ->
+									 $("parent", c) ->
+									 $("depth", depth+1);
+				}
+				pos = tag.end;
+			}
+		}
+	}
+
+	// Cut each section before and after each of its statements.
+	string synth;
+	value stmts;
+	int n = 0;
+
+	foreach (sec, sections)
+	{
+		const value &body = sec["body"];
+		value open;
+
+		for (int k=0; k<body.count(); ++k)
+		{
+			string t = tagscan::trim (lines[body[k].ival()].sval());
+			if ((t.left (8) == "@endloop") || (t.left (6) == "@endif"))
+			{
+				if (open.count()) open.rmindex (open.count()-1);
+				continue;
+			}
+
+			bool isloop = (t.left (6) == "@loop ");
+			bool isif = (t.left (4) == "@if ");
+			if ((! isloop) && (! isif) && (t.left (5) != "@set ")) continue;
+
+			// The end of the statement's block.
+			int e = k;
+			if (isloop || isif)
+			{
+				int depth = 0;
+				for (e=k; e<body.count(); ++e)
+				{
+					string tt = tagscan::trim (lines[body[e].ival()].sval());
+					if ((tt.left (6) == "@loop ") || (tt.left (4) == "@if "))
+					{
+						depth++;
+					}
+					else if ((tt.left (8) == "@endloop") ||
+							 (tt.left (6) == "@endif"))
+					{
+						if (--depth == 0) break;
+					}
+				}
+				if (e >= body.count()) e = body.count()-1;
+			}
+
+			string a = "__prof_%ia" %format (n);
+			string b = "__prof_%ib" %format (n);
+			n++;
+
+			synth.strcat ("@section %s\n" %format (a));
+			for (int x=0; x<k; ++x)
+			{
+				synth.strcat (lines[body[x].ival()].sval());
+				synth.strcat ('\n');
+			}
+			closeblocks (synth, open);
+
+			synth.strcat ("@section %s\n" %format (b));
+			for (int x=0; x<=e; ++x)
+			{
+				synth.strcat (lines[body[x].ival()].sval());
+				synth.strcat ('\n');
+			}
+			closeblocks (synth, open);
+
+			value loops;
+			foreach (o, open)
+			{
+				if (o.exists ("var")) loops.newval() = o["var"];
+			}
+
+			stmts[sec.id()].newval() = $("line", body[k]) ->
+									   $("text", t) ->
+									   $("a", a) ->
+									   $("b", b) ->
+									   $("loops", loops);
+
+			if (isloop)
+			{
+				string var = t.mid (6);
+				var.chomp ();
+				open.newval() = $("close", "@endloop") -> $("var", var);
+			}
+			else if (isif)
+			{
+				open.newval() = $("close", "@endif");
+			}
+		}
+	}
+
+	string full = script;
+	if (full.strlen() && (full[full.strlen()-1] != '\n')) full.strcat ('\n');
+	full.strcat (synth);
+
+	scriptparser P;
+	P.build (full);
+
+	int ncalls = calls.count();
+	double *spent = new double[ncalls];
+	double *called = new double[ncalls];
+
+	for (int c=0; c<ncalls; ++c)
+	{
+		const value &call = calls[c];
+		value env = senv;
+		foreach (attr, call["env"]) env[attr.id()] = attr;
+
+		string secname = call["section"];
+		spent[c] = timerun (P, env, secname);
+		called[c] = 0.0;
+
+		if (! stmts.exists (secname)) continue;
+		foreach (st, stmts[secname])
+		{
+			double d = timerun (P, env, st["b"]) - timerun (P, env, st["a"]);
+			if (d < 0.0) d = 0.0;
+
+			// Statements inside a loop over a top level array run once
+			// per element.
+			int count = 1;
+			foreach (var, st["loops"])
+			{
+				int elements = env[var.sval()].count();
+				if (elements > 1) count *= elements;
+			}
+
+			record (locations[st["line"].ival()], st["text"], count, d);
+		}
+	}
+
+	// A section is charged for its own time, without the sections it
+	// called.
+	for (int c=0; c<ncalls; ++c)
+	{
+		int parent = calls[c]["parent"].ival();
+		if (parent >= 0) called[parent] += spent[c];
+	}
+	for (int c=0; c<ncalls; ++c)
+	{
+		string secname = calls[c]["section"];
+		double own = spent[c] - called[c];
+		if (own < 0.0) own = 0.0;
+		record (locations[sections[secname]["head"].ival()],
+				"@section %s" %format (secname), 1, own);
+	}
+
+	delete[] spent;
+	delete[] called;
+}
+
+// ==========================================================================
+// METHOD templateprofiler::timerun
+// ==========================================================================
+double templateprofiler::timerun (scriptparser &P, const value &env,
+								  const string &section)
+{
+	double total = 0.0;
+	string out;
+
+	for (int r=0; r<PROFILE_REPS; ++r)
+	{
+		value e = env;
+		out.crop ();
+		double t0 = profnow ();
+		P.run (e, out, section);
+		total += profnow () - t0;
+	}
+
+	return total / PROFILE_REPS;
+}
+
+// ==========================================================================
+// METHOD templateprofiler::record
+// ==========================================================================
+void templateprofiler::record (const string &loc, const string &text,
+							   int count, double t)
+{
+	value &r = results[loc];
+	r["text"] = text;
+	r["count"] = r["count"].ival() + count;
+	r["time"] = r["time"].dval() + t;
+}
+
+// ==========================================================================
+// METHOD templateprofiler::aggregate
+// ==========================================================================
+void templateprofiler::aggregate (const string &path)
+{
+	filelock lck ("%s.lock" %format (path));
+	value total;
+	if (fs.exists (path)) total.loadxml (path);
+
+	foreach (r, results)
+	{
+		value &t = total[r.id()];
+		t["text"] = r["text"];
+		t["count"] = t["count"].ival() + r["count"].ival();
+		t["time"] = t["time"].dval() + r["time"].dval();
+	}
+
+	total.savexml (path);
+}
+
+//  -------------------------------------------------------------------------
+/// Report line, for sorting.
+//  -------------------------------------------------------------------------
+struct profentry
+{
+	double			 t; ///< Total time.
+	int				 idx; ///< Index in the results.
+};
+
+//  =========================================================================
+/// Sort order for report lines, most expensive first.
+//  =========================================================================
+static int cmpentry (const void *a, const void *b)
+{
+	double ta = ((const profentry *) a)->t;
+	double tb = ((const profentry *) b)->t;
+	if (ta > tb) return -1;
+	if (ta < tb) return 1;
+	return 0;
+}
+
+// ==========================================================================
+// METHOD templateprofiler::report
+// ==========================================================================
+void templateprofiler::report (const value &res)
+{
+	int cnt = res.count();
+	if (! cnt) return;
+
+	profentry *ents = new profentry[cnt];
+	for (int i=0; i<cnt; ++i)
+	{
+		ents[i].t = res[i]["time"].dval();
+		ents[i].idx = i;
+	}
+	qsort (ents, cnt, sizeof (profentry), cmpentry);
+
+	ferr.writeln ("      ms     count  location                      "
+				  "statement");
+	for (int i=0; i<cnt; ++i)
+	{
+		const value &r = res[ents[i].idx];
+		ferr.writeln ("%8.3f  %8i  %-28s  %s"
+					  %format (r["time"].dval() * 1000.0, r["count"].ival(),
+							   r.id().sval(), r["text"].sval()));
+	}
+
+	delete[] ents;
+}
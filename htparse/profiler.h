@@ -0,0 +1,69 @@
+#ifndef _htparse_profiler_H
+#define _htparse_profiler_H 1
+#include <grace/value.h>
+#include <grace/str.h>
+#include <grace/scriptparser.h>
+
+/// Number of timed runs per measurement.
+#define PROFILE_REPS 16
+
+/// How deep tags in called sections are followed.
+#define PROFILE_DEPTH 8
+
+/// Most section calls profiled for a page.
+#define PROFILE_MAXCALLS 1024
+
+//  -------------------------------------------------------------------------
+/// Execution profiler for templates. The script parser can only run
+/// whole sections, so statements are measured by difference: for every
+/// @loop, @if and @set in a section, a copy of the section cut off just
+/// before the statement and one cut off just after it (with any open
+/// blocks closed) are added to the script as synthetic sections. The
+/// statement's cost is the difference between their run times. Each
+/// section is run once for every tag in the page that invokes it, with
+/// the tag's attributes in the environment, so counts and times add up
+/// the way the page uses them. Tags in the sections called are followed
+/// too; the time of a section is its own, without the sections it calls
+/// (a statement's time does include the tags in its lines). Results are
+/// attributed to lines of the template or the page source.
+//  -------------------------------------------------------------------------
+class templateprofiler
+{
+public:
+					 templateprofiler (void);
+					~templateprofiler (void);
+
+					 /// Profile a page.
+					 /// \param script The template followed by the page.
+					 /// \param senv The environment the page renders with.
+					 /// \param tmplname File name of the template.
+					 /// \param tmpllines Number of lines of the template.
+					 /// \param pagename File name of the page.
+	void			 profile (const string &script, const value &senv,
+							  const string &tmplname, int tmpllines,
+							  const string &pagename);
+
+					 /// Add the results to a profile file shared by the
+					 /// htparse runs of a site build.
+	void			 aggregate (const string &path);
+
+					 /// Print the results, most expensive first.
+	void			 report (void) { report (results); }
+
+					 /// Print a set of results, most expensive first.
+					 /// \param res Results by location.
+	static void		 report (const value &res);
+
+protected:
+					 /// Mean run time of a section over PROFILE_REPS runs.
+	double			 timerun (scriptparser &P, const value &env,
+							  const string &section);
+
+					 /// Add a measurement.
+	void			 record (const string &loc, const string &text,
+							 int count, double t);
+
+	value			 results; ///< Count, time and text by location.
+};
+
+#endif
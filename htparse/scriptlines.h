@@ -0,0 +1,92 @@
+#ifndef _htparse_scriptlines_H
+#define _htparse_scriptlines_H 1
+#include <grace/str.h>
+#include <string.h>
+#include "pagearena.h"
+#include "../common/linecursor.h"
+
+//  -------------------------------------------------------------------------
+/// A line of template source, pointing into the script it came from.
+//  -------------------------------------------------------------------------
+struct scriptline
+{
+	const char		*text; ///< Start of the line.
+	int				 len; ///< Length, without the line ending.
+	const char		*stmt; ///< First character that isn't a space or tab.
+	int				 stmtlen; ///< Length from there.
+
+					 /// Checks if the line starts with a text.
+	bool			 starts (const char *s) const
+					 {
+					 	int n = strlen (s);
+					 	return (len >= n) && (! memcmp (text, s, n));
+					 }
+
+					 /// Checks if the line without leading blanks starts
+					 /// with a text.
+	bool			 stmtstarts (const char *s) const
+					 {
+					 	int n = strlen (s);
+					 	return (stmtlen >= n) && (! memcmp (stmt, s, n));
+					 }
+
+					 /// Checks if the line holds a << tag opener.
+	bool			 hastag (void) const
+					 {
+					 	for (int i=0; (i+1) < len; ++i)
+					 	{
+					 		if ((text[i] == '<') && (text[i+1] == '<')) return true;
+					 	}
+					 	return false;
+					 }
+};
+
+//  -------------------------------------------------------------------------
+/// The lines of a page script as a table in the page arena, so walking
+/// the template and page source for every page doesn't copy each line
+/// into a string of its own. Lines are split like linecursor does. The
+/// script must outlive the table and the arena must not be reset
+/// before the table is done with.
+//  -------------------------------------------------------------------------
+class scriptlines
+{
+public:
+					 /// Constructor.
+					 /// \param arena Arena for the table.
+					 /// \param script The script.
+					 scriptlines (pagearena &arena, const string &script)
+					 {
+					 	count = 0;
+					 	linecursor c (script);
+					 	while (c.next()) count++;
+
+					 	lines = (scriptline *)
+					 		arena.alloc ((count ? count : 1) * sizeof (scriptline));
+
+					 	linecursor lc (script);
+					 	for (int i=0; (i < count) && lc.next(); ++i)
+					 	{
+					 		scriptline &l = lines[i];
+					 		l.text = lc.line();
+					 		l.len = lc.length();
+					 		int j = 0;
+					 		while ((j < l.len) &&
+					 			   ((l.text[j] == ' ') || (l.text[j] == '\t'))) ++j;
+					 		l.stmt = l.text + j;
+					 		l.stmtlen = l.len - j;
+					 	}
+					 }
+					~scriptlines (void)
+					 {
+					 }
+
+					 /// A line.
+	const scriptline &operator[] (int i) const { return lines[i]; }
+
+	int				 count; ///< Number of lines.
+
+protected:
+	scriptline		*lines; ///< The table, in the arena.
+};
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef _htparse_tagscan_H
+#define _htparse_tagscan_H 1
+#include <grace/str.h>
+#include <grace/value.h>
+
+//  -------------------------------------------------------------------------
+/// A <<name attr="value" ...>> tag in a line of template source, which
+/// the script parser expands by running the section of that name.
+//  -------------------------------------------------------------------------
+struct templatetag
+{
+	int				 start; ///< Offset of the opening <<.
+	int				 end; ///< Offset past the closing >>.
+	string			 name; ///< The section, /name for closing tags.
+	value			 attr; ///< The attributes.
+};
+
+//  -------------------------------------------------------------------------
+/// Helpers for looking at template source the way the script parser
+/// does, line by line.
+//  -------------------------------------------------------------------------
+class tagscan
+{
+public:
+					 /// Finds the next complete tag in a line.
+					 /// \param ln The line.
+					 /// \param from Offset to start looking at.
+					 /// \param tag Receives the tag.
+					 /// \return False if there are no more tags.
+	static bool		 find (const string &ln, int from, templatetag &tag)
+					 {
+					 	const char *p = ln.str();
+					 	int sz = ln.strlen();
+
+					 	for (int i=from; (i+1) < sz; ++i)
+					 	{
+					 		if ((p[i] != '<') || (p[i+1] != '<')) continue;
+
+					 		int j = i+2;
+					 		int ns = j;
+					 		while ((j < sz) && (p[j] != ' ') && (p[j] != '>')) ++j;
+					 		tag.start = i;
+					 		tag.name = ln.mid (ns, j-ns);
+					 		tag.attr.clear ();
+
+					 		while ((j < sz) && (p[j] != '>'))
+					 		{
+					 			while ((j < sz) && (p[j] == ' ')) ++j;
+					 			int ks = j;
+					 			while ((j < sz) && (p[j] != '=') && (p[j] != '>') &&
+					 				   (p[j] != ' ')) ++j;
+					 			if ((j >= sz) || (p[j] != '=') || ((j+1) >= sz) ||
+					 				(p[j+1] != '"')) break;
+
+					 			string key = ln.mid (ks, j-ks);
+					 			j += 2;
+					 			int vs = j;
+					 			while ((j < sz) && (p[j] != '"')) ++j;
+					 			tag.attr[key] = ln.mid (vs, j-vs);
+					 			j++;
+					 		}
+
+					 		if (((j+1) < sz) && (p[j] == '>') && (p[j+1] == '>'))
+					 		{
+					 			tag.end = j+2;
+					 			return true;
+					 		}
+					 		i = j;
+					 	}
+					 	return false;
+					 }
+
+					 /// Splits a line into words on spaces and tabs.
+	static value	*words (const string &ln)
+					 {
+					 	returnclass (value) res retain;
+					 	int sz = ln.strlen();
+					 	int i = 0;
+					 	while (i < sz)
+					 	{
+					 		while ((i < sz) && ((ln[i] == ' ') || (ln[i] == '\t'))) ++i;
+					 		int st = i;
+					 		while ((i < sz) && (ln[i] != ' ') && (ln[i] != '\t')) ++i;
+					 		if (i > st) res.newval() = ln.mid (st, i-st);
+					 	}
+					 	return &res;
+					 }
+
+					 /// Returns a line without leading and trailing
+					 /// whitespace.
+	static string	*trim (const string &ln)
+					 {
+					 	returnclass (string) res retain;
+					 	int i = 0;
+					 	while ((i < (int) ln.strlen()) &&
+					 		   ((ln[i] == ' ') || (ln[i] == '\t'))) ++i;
+					 	res = ln.mid (i);
+					 	res.chomp ();
+					 	return &res;
+					 }
+};
+
+#endif
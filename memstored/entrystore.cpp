@@ -0,0 +1,394 @@
+#include "entrystore.h"
+#include <stdlib.h>
+#include <string.h>
+
+// ==========================================================================
+// CONSTRUCTOR SlabPool
+// ==========================================================================
+SlabPool::SlabPool (void)
+{
+	reserved = inuse = 0;
+	pages = carve = NULL;
+	left = 0;
+	nclasses = 0;
+	
+	// Sizes stay a multiple of 8 so every block is aligned for a
+	// pointer; the first 16 bytes of a page hold the page link.
+	unsigned int sz = 16;
+	while ((sz <= (SLAB_PAGESIZE - 16)) && (nclasses < SLAB_MAXCLASSES))
+	{
+		freelist[nclasses] = NULL;
+		sizes[nclasses++] = sz;
+		sz = ((sz + (sz / 2)) + 7) & ~7;
+	}
+}
+
+// ==========================================================================
+// DESTRUCTOR SlabPool
+// ==========================================================================
+SlabPool::~SlabPool (void)
+{
+	clear ();
+}
+
+// ==========================================================================
+// METHOD SlabPool::classof
+// ==========================================================================
+int SlabPool::classof (unsigned int sz) const
+{
+	for (int i=0; i<nclasses; ++i)
+	{
+		if (sizes[i] >= sz) return i;
+	}
+	return -1;
+}
+
+// ==========================================================================
+// METHOD SlabPool::alloc
+// ==========================================================================
+char *SlabPool::alloc (unsigned int sz)
+{
+	int c = classof (sz);
+	if (c < 0)
+	{
+		reserved += sz;
+		inuse += sz;
+		return (char *) malloc (sz);
+	}
+	
+	unsigned int bsz = sizes[c];
+	inuse += bsz;
+	
+	char *res = freelist[c];
+	if (res)
+	{
+		freelist[c] = *((char **) res);
+		return res;
+	}
+	
+	if (left < bsz)
+	{
+		char *pg = (char *) malloc (SLAB_PAGESIZE);
+		*((char **) pg) = pages;
+		pages = pg;
+		carve = pg + 16;
+		left = SLAB_PAGESIZE - 16;
+		reserved += SLAB_PAGESIZE;
+	}
+	
+	res = carve;
+	carve += bsz;
+	left -= bsz;
+	return res;
+}
+
+// ==========================================================================
+// METHOD SlabPool::release
+// ==========================================================================
+void SlabPool::release (char *p, unsigned int sz)
+{
+	int c = classof (sz);
+	if (c < 0)
+	{
+		reserved -= sz;
+		inuse -= sz;
+		free (p);
+		return;
+	}
+	
+	inuse -= sizes[c];
+	*((char **) p) = freelist[c];
+	freelist[c] = p;
+}
+
+// ==========================================================================
+// METHOD SlabPool::clear
+// ==========================================================================
+void SlabPool::clear (void)
+{
+	while (pages)
+	{
+		char *next = *((char **) pages);
+		free (pages);
+		pages = next;
+		reserved -= SLAB_PAGESIZE;
+	}
+	
+	for (int i=0; i<nclasses; ++i) freelist[i] = NULL;
+	carve = NULL;
+	left = 0;
+}
+
+// ==========================================================================
+// CONSTRUCTOR EntryStore
+// ==========================================================================
+EntryStore::EntryStore (void)
+{
+	tsize = 1024;
+	entries = used = gzipped = 0;
+	table = (memslot *) calloc (tsize, sizeof (memslot));
+	
+	// Index 0 is the fallback once the index space runs out.
+	intern ("application/octet-stream");
+}
+
+// ==========================================================================
+// DESTRUCTOR EntryStore
+// ==========================================================================
+EntryStore::~EntryStore (void)
+{
+	clear ();
+	free (table);
+}
+
+// ==========================================================================
+// METHOD EntryStore::hashkey
+// ==========================================================================
+uint32_t EntryStore::hashkey (const char *key, unsigned int len)
+{
+	// FNV-1a
+	uint32_t h = 2166136261U;
+	for (unsigned int i=0; i<len; ++i)
+	{
+		h ^= (unsigned char) key[i];
+		h *= 16777619U;
+	}
+	return h;
+}
+
+// ==========================================================================
+// METHOD EntryStore::locate
+// ==========================================================================
+int EntryStore::locate (const char *key, unsigned int len, uint32_t h) const
+{
+	unsigned int mask = tsize - 1;
+	
+	// The table is never more than 70% used, so there's always an
+	// empty slot to stop at.
+	for (unsigned int i = h & mask; ; i = (i+1) & mask)
+	{
+		const memslot &s = table[i];
+		if (! s.blob) return -1;
+		if ((s.blob != SLOT_TOMBSTONE) && (s.hash == h) &&
+			(s.keylen == len) && (! memcmp (s.blob, key, len)))
+		{
+			return i;
+		}
+	}
+}
+
+// ==========================================================================
+// METHOD EntryStore::find
+// ==========================================================================
+const memslot *EntryStore::find (const string &key) const
+{
+	unsigned int len = key.strlen();
+	int i = locate (key.str(), len, hashkey (key.str(), len));
+	if (i < 0) return NULL;
+	return table + i;
+}
+
+// ==========================================================================
+// METHOD EntryStore::set
+// ==========================================================================
+bool EntryStore::set (const string &key, const string &ctype,
+					  const string &data, int expires, bool gz)
+{
+	unsigned int len = key.strlen();
+	if (len > 0xffff) return false;
+	
+	unsigned int dlen = data.strlen();
+	uint32_t h = hashkey (key.str(), len);
+	int i = locate (key.str(), len, h);
+	
+	char *blob = pool.alloc (len + dlen);
+	if (len) memcpy (blob, key.str(), len);
+	if (dlen) memcpy (blob + len, data.str(), dlen);
+	
+	if (i >= 0)
+	{
+		memslot &old = table[i];
+		pool.release (old.blob, old.keylen + old.datalen);
+		if (old.ctype & SLOT_GZIP) gzipped--;
+	}
+	else
+	{
+		if (((used + 1) * 10) > (tsize * 7))
+		{
+			// Grow if it's mostly documents, otherwise a rebuild at the
+			// same size clears out the tombstones.
+			resize (((entries * 2) > tsize) ? (tsize * 2) : tsize);
+		}
+		
+		unsigned int mask = tsize - 1;
+		unsigned int n = h & mask;
+		while (table[n].blob && (table[n].blob != SLOT_TOMBSTONE))
+		{
+			n = (n+1) & mask;
+		}
+		
+		if (! table[n].blob) used++;
+		entries++;
+		i = n;
+	}
+	
+	memslot &s = table[i];
+	s.blob = blob;
+	s.hash = h;
+	s.datalen = dlen;
+	s.expires = expires;
+	s.keylen = len;
+	s.ctype = intern (ctype);
+	if (gz)
+	{
+		s.ctype |= SLOT_GZIP;
+		gzipped++;
+	}
+	return true;
+}
+
+// ==========================================================================
+// METHOD EntryStore::remove
+// ==========================================================================
+bool EntryStore::remove (const string &key)
+{
+	unsigned int len = key.strlen();
+	int i = locate (key.str(), len, hashkey (key.str(), len));
+	if (i < 0) return false;
+	
+	memslot &s = table[i];
+	pool.release (s.blob, s.keylen + s.datalen);
+	if (s.ctype & SLOT_GZIP) gzipped--;
+	s.blob = SLOT_TOMBSTONE;
+	entries--;
+	return true;
+}
+
+// ==========================================================================
+// METHOD EntryStore::copyout
+// ==========================================================================
+void EntryStore::copyout (const memslot *s, value &into) const
+{
+	string data;
+	if (s->datalen) data.strcat (s->blob + s->keylen, s->datalen);
+	
+	into = $("Content-type", types[s->ctype & ~SLOT_GZIP]) ->
+		   $("data", data);
+		   
+	if (s->expires) into["expires"] = s->expires;
+	if (s->ctype & SLOT_GZIP) into["Content-encoding"] = "gzip";
+}
+
+// ==========================================================================
+// METHOD EntryStore::dump
+// ==========================================================================
+value *EntryStore::dump (void) const
+{
+	returnclass (value) res retain;
+	
+	for (unsigned int i=0; i<tsize; ++i)
+	{
+		const memslot &s = table[i];
+		if ((! s.blob) || (s.blob == SLOT_TOMBSTONE)) continue;
+		
+		string key;
+		key.strcat (s.blob, s.keylen);
+		copyout (&s, res[key]);
+	}
+	
+	return &res;
+}
+
+// ==========================================================================
+// METHOD EntryStore::load
+// ==========================================================================
+void EntryStore::load (const value &v)
+{
+	clear ();
+	foreach (ent, v)
+	{
+		set (ent.id().sval(), ent["Content-type"].sval(),
+			 ent["data"].sval(), ent["expires"].ival(),
+			 ent.exists ("Content-encoding"));
+	}
+}
+
+// ==========================================================================
+// METHOD EntryStore::clear
+// ==========================================================================
+void EntryStore::clear (void)
+{
+	for (unsigned int i=0; i<tsize; ++i)
+	{
+		memslot &s = table[i];
+		if (s.blob && (s.blob != SLOT_TOMBSTONE))
+		{
+			pool.release (s.blob, s.keylen + s.datalen);
+		}
+		s.blob = NULL;
+	}
+	
+	pool.clear ();
+	entries = used = gzipped = 0;
+}
+
+// ==========================================================================
+// METHOD EntryStore::resize
+// ==========================================================================
+void EntryStore::resize (unsigned int sz)
+{
+	memslot *old = table;
+	unsigned int oldsize = tsize;
+	
+	table = (memslot *) calloc (sz, sizeof (memslot));
+	tsize = sz;
+	used = entries;
+	
+	unsigned int mask = tsize - 1;
+	for (unsigned int i=0; i<oldsize; ++i)
+	{
+		const memslot &s = old[i];
+		if ((! s.blob) || (s.blob == SLOT_TOMBSTONE)) continue;
+		
+		unsigned int n = s.hash & mask;
+		while (table[n].blob) n = (n+1) & mask;
+		table[n] = s;
+	}
+	
+	free (old);
+}
+
+// ==========================================================================
+// METHOD EntryStore::intern
+// ==========================================================================
+unsigned int EntryStore::intern (const string &ctype)
+{
+	if (typeidx.exists (ctype)) return typeidx[ctype].ival();
+	if (types.count() >= SLOT_GZIP) return 0;
+	
+	unsigned int res = types.count();
+	types.newval() = ctype;
+	typeidx[ctype] = (int) res;
+	return res;
+}
+
+// ==========================================================================
+// METHOD EntryStore::usage
+// ==========================================================================
+value *EntryStore::usage (void) const
+{
+	returnclass (value) res retain;
+	
+	unsigned long long tablebytes = tsize * sizeof (memslot);
+	unsigned long long total = tablebytes + pool.reserved;
+	
+	res["entries"] = entries;
+	res["slots"] = tsize;
+	res["types"] = types.count();
+	res["gzipped"] = gzipped;
+	res["tablebytes"] = tablebytes;
+	res["blobbytes"] = (unsigned long long) pool.inuse;
+	res["slabbytes"] = (unsigned long long) pool.reserved;
+	res["bytesperentry"] = entries ? ((double) total / entries) : 0.0;
+	return &res;
+}
@@ -0,0 +1,144 @@
+#ifndef _memstored_entrystore_H
+#define _memstored_entrystore_H 1
+#include <grace/value.h>
+#include <grace/str.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define SLAB_PAGESIZE 65536
+#define SLAB_MAXCLASSES 32
+#define SLOT_TOMBSTONE ((char *) 1)
+#define SLOT_GZIP 0x8000
+
+//  -------------------------------------------------------------------------
+/// Size-classed slab allocator for entry blobs. Block sizes are 1.5
+/// times apart, from 16 bytes up to a page, and blocks are carved out
+/// of 64KB pages. A freed block goes on the free list of its class,
+/// linked through its own first bytes. The caller passes the size back
+/// on release, so blocks carry no header. Bigger blobs go to malloc.
+//  -------------------------------------------------------------------------
+class SlabPool
+{
+public:
+					 SlabPool (void);
+					~SlabPool (void);
+					
+					 /// Allocate a block.
+					 /// \param sz Bytes needed.
+	char			*alloc (unsigned int sz);
+	
+					 /// Return a block.
+					 /// \param p The block.
+					 /// \param sz The size it was allocated with.
+	void			 release (char *p, unsigned int sz);
+	
+					 /// Give all pages back. Large blocks must have
+					 /// been released first.
+	void			 clear (void);
+	
+	size_t			 reserved; ///< Bytes taken from malloc.
+	size_t			 inuse; ///< Bytes in blocks handed out.
+
+protected:
+					 /// Class for a size, -1 if it needs malloc.
+	int				 classof (unsigned int sz) const;
+
+	unsigned int	 sizes[SLAB_MAXCLASSES]; ///< Block size by class.
+	int				 nclasses; ///< Number of classes.
+	char			*freelist[SLAB_MAXCLASSES]; ///< Free blocks by class.
+	char			*pages; ///< All pages, linked through their start.
+	char			*carve; ///< Next unused byte in the newest page.
+	unsigned int	 left; ///< Unused bytes in the newest page.
+};
+
+//  -------------------------------------------------------------------------
+/// A stored document. The blob holds the key followed by the data, so
+/// the key is kept once; content types are interned by the store.
+//  -------------------------------------------------------------------------
+struct memslot
+{
+	char			*blob; ///< Key bytes then data bytes, or NULL if free.
+	uint32_t		 hash; ///< Hash of the key.
+	uint32_t		 datalen; ///< Length of the data.
+	int32_t			 expires; ///< Deadline in unix time, or 0.
+	uint16_t		 keylen; ///< Length of the key.
+	uint16_t		 ctype; ///< Index of the content type, plus
+							///< SLOT_GZIP if the data is gzipped.
+};
+
+//  -------------------------------------------------------------------------
+/// Compact storage for the documents in a MemStore: an open addressing
+/// hash table of 24 byte slots with the blobs in a SlabPool. A value
+/// dict spends a node, a key and two strings with their own headers on
+/// every entry; this costs the slot and the blob rounded up to its
+/// size class. Not thread-safe, MemStore wraps it in a lock.
+//  -------------------------------------------------------------------------
+class EntryStore
+{
+public:
+					 EntryStore (void);
+					~EntryStore (void);
+					
+					 /// Look up a key.
+					 /// \return The slot, valid until the next change,
+					 ///         or NULL.
+	const memslot	*find (const string &key) const;
+	
+					 /// Store a document, replacing any old one.
+					 /// \param key The key.
+					 /// \param ctype The content type.
+					 /// \param data The data.
+					 /// \param expires Deadline, or 0.
+					 /// \param gz True if the data is gzipped.
+					 /// \return False if the key is too long.
+	bool			 set (const string &key, const string &ctype,
+						  const string &data, int expires,
+						  bool gz = false);
+	
+					 /// Remove a document.
+					 /// \return False if there was none.
+	bool			 remove (const string &key);
+	
+					 /// Unpack a slot as Content-type, data and, if
+					 /// set, expires and Content-encoding.
+	void			 copyout (const memslot *s, value &into) const;
+	
+					 /// All documents, as a dict in the copyout format.
+	value			*dump (void) const;
+	
+					 /// Replace the contents with a dump.
+	void			 load (const value &v);
+	
+					 /// Remove all documents.
+	void			 clear (void);
+	
+					 /// Memory statistics, for /_memory.
+	value			*usage (void) const;
+	
+					 /// Number of documents.
+	unsigned int	 count (void) const { return entries; }
+
+protected:
+	static uint32_t	 hashkey (const char *key, unsigned int len);
+	
+					 /// Index of the slot holding a key, or -1.
+	int				 locate (const char *key, unsigned int len,
+							 uint32_t h) const;
+	
+					 /// Rebuild the table, dropping tombstones.
+	void			 resize (unsigned int sz);
+	
+					 /// Index of a content type, added if it's new.
+	unsigned int	 intern (const string &ctype);
+
+	memslot			*table; ///< The slots.
+	unsigned int	 tsize; ///< Number of slots, a power of two.
+	unsigned int	 entries; ///< Slots holding a document.
+	unsigned int	 gzipped; ///< Documents stored gzipped.
+	unsigned int	 used; ///< Slots holding a document or a tombstone.
+	SlabPool		 pool; ///< Storage for the blobs.
+	value			 types; ///< Content types by index.
+	value			 typeidx; ///< Index by content type.
+};
+
+#endif
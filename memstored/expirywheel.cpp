@@ -0,0 +1,130 @@
+#include "expirywheel.h"
+
+// ==========================================================================
+// CONSTRUCTOR ExpiryWheel
+// ==========================================================================
+ExpiryWheel::ExpiryWheel (void)
+{
+	current = time (NULL);
+	filed = 0;
+	for (int i=0; i<256; ++i) slots.o.newval ();
+}
+
+// ==========================================================================
+// DESTRUCTOR ExpiryWheel
+// ==========================================================================
+ExpiryWheel::~ExpiryWheel (void)
+{
+}
+
+// ==========================================================================
+// METHOD ExpiryWheel::schedule
+// ==========================================================================
+void ExpiryWheel::schedule (const statstring &key, time_t at)
+{
+	exclusivesection (slots)
+	{
+		// The slot for the current second has already been emptied.
+		if (at <= current) at = current + 1;
+		place ($("key", key) -> $("at", (int) at));
+		filed++;
+	}
+}
+
+// ==========================================================================
+// METHOD ExpiryWheel::advance
+// ==========================================================================
+value *ExpiryWheel::advance (time_t now)
+{
+	returnclass (value) res retain;
+	
+	exclusivesection (slots)
+	{
+		// An empty wheel or a long clock jump isn't worth stepping
+		// through second by second.
+		if ((! filed) || ((now - current) > EXPIRY_MAXSTEP))
+		{
+			if (now > current) jump (now, res);
+		}
+		
+		while (current < now)
+		{
+			current++;
+			
+			// When a level wraps, the next slot of the level above it
+			// comes within reach and is spread out below.
+			if (! (current & 63))
+			{
+				if (! ((current >> 6) & 63))
+				{
+					if (! ((current >> 12) & 63))
+					{
+						cascade (3, (current >> 18) & 63);
+					}
+					cascade (2, (current >> 12) & 63);
+				}
+				cascade (1, (current >> 6) & 63);
+			}
+			
+			value &slot = slots.o[current & 63];
+			foreach (ent, slot) res.newval() = ent;
+			filed -= slot.count();
+			slot.clear ();
+		}
+	}
+	
+	return &res;
+}
+
+// ==========================================================================
+// METHOD ExpiryWheel::place
+// ==========================================================================
+void ExpiryWheel::place (const value &ent)
+{
+	time_t at = ent["at"].ival();
+	if (at < current) at = current;
+	time_t delta = at - current;
+	int idx;
+	
+	if (delta < 64) idx = at & 63;
+	else if (delta < (64 << 6)) idx = 64 + ((at >> 6) & 63);
+	else if (delta < (64 << 12)) idx = 128 + ((at >> 12) & 63);
+	else if (delta < (64 << 18)) idx = 192 + ((at >> 18) & 63);
+	else idx = 192 + (((current >> 18) + 63) & 63);
+	
+	slots.o[idx].newval() = ent;
+}
+
+// ==========================================================================
+// METHOD ExpiryWheel::cascade
+// ==========================================================================
+void ExpiryWheel::cascade (int level, int slot)
+{
+	value ents = slots.o[(level * 64) + slot];
+	slots.o[(level * 64) + slot].clear ();
+	foreach (ent, ents) place (ent);
+}
+
+// ==========================================================================
+// METHOD ExpiryWheel::jump
+// ==========================================================================
+void ExpiryWheel::jump (time_t now, value &due)
+{
+	value ents;
+	for (int i=0; i<256; ++i)
+	{
+		foreach (ent, slots.o[i]) ents.newval() = ent;
+		slots.o[i].clear ();
+	}
+	
+	current = now;
+	foreach (ent, ents)
+	{
+		if (ent["at"].ival() <= now)
+		{
+			due.newval() = ent;
+			filed--;
+		}
+		else place (ent);
+	}
+}
@@ -0,0 +1,57 @@
+#ifndef _memstored_expirywheel_H
+#define _memstored_expirywheel_H 1
+#include <grace/value.h>
+#include <grace/statstring.h>
+#include <grace/lock.h>
+#include <time.h>
+
+/// Longest gap advance() steps through one second at a time.
+#define EXPIRY_MAXSTEP 4096
+
+//  -------------------------------------------------------------------------
+/// Hierarchical timing wheel for key expiry. Four levels of 64 slots
+/// cover one second, 64 seconds, 68 minutes and 73 hours per slot. A
+/// key is filed on the coarsest level that fits its deadline and drops
+/// a level each time the wheel below it wraps, so scheduling and
+/// expiring cost O(1) amortized no matter how many keys are waiting.
+/// Deadlines further out than the wheel reaches wait on the top level
+/// and get re-filed when they come around. The wheel steps a second at
+/// a time; after a clock jump of more than EXPIRY_MAXSTEP seconds it is
+/// rebuilt instead, at a cost of one pass over the waiting keys.
+//  -------------------------------------------------------------------------
+class ExpiryWheel
+{
+public:
+					 ExpiryWheel (void);
+					~ExpiryWheel (void);
+					
+					 /// File a key for expiry.
+					 /// \param key The key.
+					 /// \param at Deadline, in unix time.
+	void			 schedule (const statstring &key, time_t at);
+	
+					 /// Advance the wheel up to a point in time.
+					 /// \param now The current unix time.
+					 /// \return Array of the keys and deadlines that
+					 ///         came due, as $("key")->$("at").
+	value			*advance (time_t now);
+
+protected:
+					 /// File an entry, caller holds the lock.
+	void			 place (const value &ent);
+	
+					 /// Re-file the entries of a slot one level down.
+	void			 cascade (int level, int slot);
+	
+					 /// Move the wheel straight to a point in time,
+					 /// caller holds the lock.
+					 /// \param now The new current time.
+					 /// \param due Array to add the due entries to.
+	void			 jump (time_t now, value &due);
+
+	lock<value>		 slots; ///< Entry arrays by level*64+slot.
+	time_t			 current; ///< Last second processed.
+	int				 filed; ///< Entries waiting in the wheel.
+};
+
+#endif
@@ -0,0 +1,312 @@
+#ifndef _memstored_httpdstats_H
+#define _memstored_httpdstats_H 1
+#include <grace/value.h>
+#include <grace/str.h>
+#include <grace/lock.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+/// Number of latency histogram buckets. Bucket n counts requests that
+/// took less than 2^(n+1) microseconds, the last one catches the rest.
+#define HTTPDSTATS_BUCKETS 24
+
+/// Request methods, as counted.
+#define HTTPDSTATS_GET 0
+#define HTTPDSTATS_POST 1
+#define HTTPDSTATS_PUT 2
+#define HTTPDSTATS_DELETE 3
+#define HTTPDSTATS_OTHER 4
+#define HTTPDSTATS_METHODS 5
+
+/// Lock sections, as counted.
+#define HTTPDSTATS_SHARED 0
+#define HTTPDSTATS_EXCLUSIVE 1
+#define HTTPDSTATS_LOCKS 2
+
+//  -------------------------------------------------------------------------
+/// Counters of one thread. Only the owning thread writes them, so no
+/// lock or locked instruction is involved; a reader may be a few counts
+/// behind. Each block starts on its own cache line.
+//  -------------------------------------------------------------------------
+struct threadstats
+{
+	uint64_t		 requests[HTTPDSTATS_METHODS]; ///< Requests handled.
+	uint64_t		 usec[HTTPDSTATS_METHODS]; ///< Total handling time.
+	uint64_t		 hist[HTTPDSTATS_METHODS][HTTPDSTATS_BUCKETS]; ///< Latencies.
+	uint64_t		 waits[HTTPDSTATS_LOCKS]; ///< Lock sections entered.
+	uint64_t		 waitusec[HTTPDSTATS_LOCKS]; ///< Time spent getting in.
+	uint64_t		 busy; ///< Microseconds spent handling requests.
+	threadstats		*next; ///< Next block in the registry.
+} __attribute__ ((aligned (64)));
+
+//  -------------------------------------------------------------------------
+/// Runtime metrics for memstored. Every thread that records
+/// something gets its own threadstats block, registered once in a
+/// global list; report() walks the list and adds the blocks up. The
+/// registry mutex is only taken when a thread records its first event
+/// and when a report is made.
+//  -------------------------------------------------------------------------
+class httpdstats
+{
+public:
+					 /// Mark the start of the measuring period, used for
+					 /// uptime and thread utilization.
+	static void		 start (void) { epoch() = clock (); }
+
+					 /// Monotonic time in microseconds.
+	static uint64_t	 clock (void)
+					 {
+					 	struct timespec ts;
+					 	clock_gettime (CLOCK_MONOTONIC, &ts);
+					 	return ((uint64_t) ts.tv_sec * 1000000) +
+					 		   (ts.tv_nsec / 1000);
+					 }
+
+					 /// Method index for an httpd request.
+					 /// \param env The request's meta-variables.
+	static int		 method (value &env)
+					 {
+					 	const string &m = env["method"].sval();
+					 	if (m == "GET") return HTTPDSTATS_GET;
+					 	if (m == "POST") return HTTPDSTATS_POST;
+					 	if (m == "PUT") return HTTPDSTATS_PUT;
+					 	if (m == "DELETE") return HTTPDSTATS_DELETE;
+					 	return HTTPDSTATS_OTHER;
+					 }
+
+					 /// Count a finished request.
+					 /// \param m The method index.
+					 /// \param since clock() when it came in.
+	static void		 request (int m, uint64_t since)
+					 {
+					 	threadstats *t = mine ();
+					 	uint64_t d = clock () - since;
+					 	int b = 0;
+					 	while ((b < (HTTPDSTATS_BUCKETS-1)) && (d >> (b+1))) ++b;
+
+					 	bump (t->requests[m], 1);
+					 	bump (t->usec[m], d);
+					 	bump (t->hist[m][b], 1);
+					 	bump (t->busy, d);
+					 }
+
+					 /// Count a lock section that was just entered.
+					 /// \param kind HTTPDSTATS_SHARED or _EXCLUSIVE.
+					 /// \param since clock() before asking for the lock.
+	static void		 lockwait (int kind, uint64_t since)
+					 {
+					 	threadstats *t = mine ();
+					 	bump (t->waits[kind], 1);
+					 	bump (t->waitusec[kind], clock () - since);
+					 }
+
+					 /// The counters of all threads, added up.
+	static value	*report (void)
+					 {
+					 	returnclass (value) res retain;
+					 	static const char *mnames[HTTPDSTATS_METHODS] =
+					 		{ "GET", "POST", "PUT", "DELETE", "other" };
+					 	static const char *lnames[HTTPDSTATS_LOCKS] =
+					 		{ "shared", "exclusive" };
+
+					 	threadstats sum;
+					 	memset (&sum, 0, sizeof (sum));
+					 	uint64_t uptime = clock () - epoch();
+					 	double busy = 0.0;
+					 	int workers = 0;
+
+					 	pthread_mutex_lock (&registrylock());
+					 	for (threadstats *t = registry(); t; t = t->next)
+					 	{
+					 		for (int m=0; m<HTTPDSTATS_METHODS; ++m)
+					 		{
+					 			sum.requests[m] += get (t->requests[m]);
+					 			sum.usec[m] += get (t->usec[m]);
+					 			for (int b=0; b<HTTPDSTATS_BUCKETS; ++b)
+					 			{
+					 				sum.hist[m][b] += get (t->hist[m][b]);
+					 			}
+					 		}
+					 		for (int l=0; l<HTTPDSTATS_LOCKS; ++l)
+					 		{
+					 			sum.waits[l] += get (t->waits[l]);
+					 			sum.waitusec[l] += get (t->waitusec[l]);
+					 		}
+
+					 		uint64_t tbusy = get (t->busy);
+					 		if (! tbusy) continue;
+
+					 		value &w = res["threads"].newval();
+					 		w["busy"] = tbusy / 1000000.0;
+					 		w["utilization"] = uptime ?
+					 			((double) tbusy / uptime) : 0.0;
+					 		busy += tbusy;
+					 		workers++;
+					 	}
+					 	pthread_mutex_unlock (&registrylock());
+
+					 	res["uptime"] = uptime / 1000000.0;
+					 	res["workers"] = workers;
+					 	res["utilization"] = (workers && uptime) ?
+					 		(busy / ((double) uptime * workers)) : 0.0;
+
+					 	for (int m=0; m<HTTPDSTATS_METHODS; ++m)
+					 	{
+					 		uint64_t n = sum.requests[m];
+					 		value &r = res["methods"][mnames[m]];
+					 		r["requests"] = (unsigned long long) n;
+					 		r["mean_us"] = n ? ((double) sum.usec[m] / n) : 0.0;
+					 		r["p50_us"] = percentile (sum.hist[m], n, 50);
+					 		r["p99_us"] = percentile (sum.hist[m], n, 99);
+					 		for (int b=0; b<HTTPDSTATS_BUCKETS; ++b)
+					 		{
+					 			if (! sum.hist[m][b]) continue;
+					 			r["histogram"]["%i" %format (2 << b)] =
+					 				(unsigned long long) sum.hist[m][b];
+					 		}
+					 	}
+
+					 	for (int l=0; l<HTTPDSTATS_LOCKS; ++l)
+					 	{
+					 		uint64_t n = sum.waits[l];
+					 		value &r = res["locks"][lnames[l]];
+					 		r["entered"] = (unsigned long long) n;
+					 		r["wait"] = sum.waitusec[l] / 1000000.0;
+					 		r["mean_wait_us"] = n ?
+					 			((double) sum.waitusec[l] / n) : 0.0;
+					 	}
+
+					 	return &res;
+					 }
+
+protected:
+					 /// The calling thread's block, made on first use.
+	static threadstats *mine (void)
+					 {
+					 	static __thread threadstats *t = NULL;
+					 	if (t) return t;
+
+					 	void *mem = NULL;
+					 	if (posix_memalign (&mem, 64, sizeof (threadstats)))
+					 	{
+					 		return &overflow();
+					 	}
+					 	t = (threadstats *) mem;
+					 	memset (t, 0, sizeof (threadstats));
+
+					 	pthread_mutex_lock (&registrylock());
+					 	t->next = registry();
+					 	registry() = t;
+					 	pthread_mutex_unlock (&registrylock());
+					 	return t;
+					 }
+
+					 /// Upper bound of the bucket holding a percentile.
+	static int		 percentile (const uint64_t *hist, uint64_t n, int pct)
+					 {
+					 	if (! n) return 0;
+					 	uint64_t want = ((n * pct) + 99) / 100;
+					 	uint64_t seen = 0;
+					 	for (int b=0; b<HTTPDSTATS_BUCKETS; ++b)
+					 	{
+					 		seen += hist[b];
+					 		if (seen >= want) return 2 << b;
+					 	}
+					 	return 2 << (HTTPDSTATS_BUCKETS-1);
+					 }
+
+					 /// Add to a counter owned by this thread.
+	static void		 bump (uint64_t &c, uint64_t n)
+					 {
+					 	__atomic_store_n (&c, c + n, __ATOMIC_RELAXED);
+					 }
+
+					 /// Read another thread's counter.
+	static uint64_t	 get (const uint64_t &c)
+					 {
+					 	return __atomic_load_n (&c, __ATOMIC_RELAXED);
+					 }
+
+	static threadstats *&registry (void)
+					 {
+					 	static threadstats *head = NULL;
+					 	return head;
+					 }
+
+	static pthread_mutex_t &registrylock (void)
+					 {
+					 	static pthread_mutex_t m = PTHREAD_MUTEX_INITIALIZER;
+					 	return m;
+					 }
+
+	static uint64_t	&epoch (void)
+					 {
+					 	static uint64_t e = clock ();
+					 	return e;
+					 }
+
+					 /// Shared block for a thread that couldn't get its
+					 /// own, counts may get lost there.
+	static threadstats &overflow (void)
+					 {
+					 	static threadstats t;
+					 	return t;
+					 }
+};
+
+//  -------------------------------------------------------------------------
+/// Times a request from construction to destruction.
+//  -------------------------------------------------------------------------
+class requesttimer
+{
+public:
+					 /// Start timing.
+					 /// \param m The method index.
+					 requesttimer (int m)
+					 {
+					 	method = m;
+					 	started = httpdstats::clock ();
+					 }
+					~requesttimer (void)
+					 {
+					 	httpdstats::request (method, started);
+					 }
+
+protected:
+	int				 method; ///< The method index.
+	uint64_t		 started; ///< When the request came in.
+};
+
+//  -------------------------------------------------------------------------
+/// Holds a lock for the rest of a block and counts the time it took to
+/// get in through httpdstats::lockwait(). Takes the place of a
+/// sharedsection or exclusivesection whose wait should show up in the
+/// stats; the locked object is reached through the lock's o member.
+//  -------------------------------------------------------------------------
+template<class kind>
+class timedsection
+{
+public:
+					 /// Take the lock.
+					 /// \param l The lock.
+					 /// \param how HTTPDSTATS_SHARED or _EXCLUSIVE.
+					 timedsection (lock<kind> &l, int how) : lck (l)
+					 {
+					 	uint64_t since = httpdstats::clock ();
+					 	if (how == HTTPDSTATS_SHARED) lck.lockr ();
+					 	else lck.lockw ();
+					 	httpdstats::lockwait (how, since);
+					 }
+					~timedsection (void)
+					 {
+					 	lck.unlock ();
+					 }
+
+protected:
+	lock<kind>		&lck; ///< The lock held.
+};
+
+#endif
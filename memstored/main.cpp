@@ -0,0 +1,271 @@
+#include "memstored.h"
+#include "memstore.h"
+#include "wire.h"
+#include "replication.h"
+#include "staticpage.h"
+#include "reuseport.h"
+#include "httpdstats.h"
+#include "../common/bundlepage.h"
+#include <malloc.h>
+
+// ==========================================================================
+// CONSTRUCTOR MemStoreDaemon
+// ==========================================================================
+MemStoreDaemon::MemStoreDaemon (void) : daemon ("MemStoreDaemon")
+{
+	opt = $("-p", $("long", "--port")) ->
+		  $("-h", $("long", "--help")) ->
+		  $("--port",
+		  		$("argc", 1) ->
+		  		$("default", 1135) ->
+		  		$("help", "TCP listen port number")) ->
+		  $("-w", $("long", "--wire-port")) ->
+		  $("--wire-port",
+		  		$("argc", 1) ->
+		  		$("default", 0) ->
+		  		$("help", "TCP port for the binary protocol (0 is off)")) ->
+		  $("--wire-threads",
+		  		$("argc", 1) ->
+		  		$("default", 8) ->
+		  		$("help", "Binary protocol connections served at once")) ->
+		  $("--replica-listen",
+		  		$("argc", 1) ->
+		  		$("help", "Serve replicas on a TCP port or unix socket path")) ->
+		  $("--replica-slots",
+		  		$("argc", 1) ->
+		  		$("default", 2) ->
+		  		$("help", "Replicas served at once")) ->
+		  $("--replica-maxlag",
+		  		$("argc", 1) ->
+		  		$("default", 100000) ->
+		  		$("help", "Cut off a replica this many mutations behind "
+		  				  "(0 is never)")) ->
+		  $("--replica-of",
+		  		$("argc", 1) ->
+		  		$("help", "Run as a read-only replica of host:port or "
+		  				  "a unix socket path")) ->
+		  $("--shards",
+		  		$("argc", 1) ->
+		  		$("default", 1) ->
+		  		$("help", "HTTP listeners on the port, each with its own "
+		  				  "workers pinned to a core")) ->
+		  $("--compress-min",
+		  		$("argc", 1) ->
+		  		$("default", 0) ->
+		  		$("help", "Gzip stored documents of at least this many "
+		  				  "bytes (0 is off)")) ->
+		  $("--compress-types",
+		  		$("argc", 1) ->
+		  		$("default", "text/,application/json,application/javascript,"
+		  					 "application/xml,image/svg+xml") ->
+		  		$("help", "Comma separated content type prefixes to gzip")) ->
+		  $("--bundle",
+		  		$("argc", 1) ->
+		  		$("help", "Serve GET and HEAD from a site bundle written "
+		  				  "by sitebuild, ahead of the store")) ->
+		  $("--memtest",
+		  		$("argc", 1) ->
+		  		$("help", "Measure memory per entry for this many keys "
+		  				  "and exit"));
+	nshards = 0;
+}
+
+// ==========================================================================
+// DESTRUCTOR MemStoreDaemon
+// ==========================================================================
+MemStoreDaemon::~MemStoreDaemon (void)
+{
+	for (int i=0; i<nshards; ++i) delete shards[i];
+}
+
+// ==========================================================================
+// METHOD MemStoreDaemon::main
+// ==========================================================================
+int MemStoreDaemon::main (void)
+{
+	if (argv.exists ("--memtest"))
+	{
+		memtest (argv["--memtest"].ival());
+		return 0;
+	}
+	
+	addlogtarget (log::file, "event.log", log::all);
+	if (argv.exists ("--bundle") && (! bundle.open (argv["--bundle"])))
+	{
+		ferr.writeln ("%% Can't open bundle %s" %format (argv["--bundle"]));
+		return 1;
+	}
+	
+	int port = argv["--port"];
+	int nlisteners = argv["--shards"];
+	if (nlisteners > MAXSHARDS) nlisteners = MAXSHARDS;
+	
+	// Extra shards get their own httpd on the same port, the kernel
+	// balances connections between the listeners. Only these sockets
+	// share the port; the wire and replica listeners are bound later,
+	// outside the scope.
+	{
+		reuseportscope shared (nlisteners > 1);
+		srv.listento (port);
+		for (nshards=0; nshards < (nlisteners-1); ++nshards)
+		{
+			shards[nshards] = new httpd;
+			shards[nshards]->listento (port);
+		}
+	}
+	log::write (log::info, "main", "Starting server on "
+				"port *:%i" %format (port));
+	
+	int wireport = argv["--wire-port"];
+	if (wireport)
+	{
+		wirelistener.o.listento (wireport);
+		log::write (log::info, "main", "Binary protocol on "
+					"port *:%i" %format (wireport));
+	}
+	
+	string feedaddr = argv["--replica-listen"];
+	if (feedaddr)
+	{
+		if (feedaddr[0] == '/') feedlistener.o.listento (feedaddr);
+		else feedlistener.o.listento (argv["--replica-listen"].ival());
+		log::write (log::info, "main", "Serving replicas on %s"
+					%format (feedaddr));
+	}
+	
+	daemonize ();
+	httpdstats::start ();
+	log::write (log::info, "main", "Starting threads");
+	fixedpages (srv);
+	if (bundle.count()) new bundlepage (srv, bundle);
+	MemStore *store = new MemStore (srv);
+	
+	value ctypes;
+	string typelist = argv["--compress-types"];
+	while (typelist.strlen())
+	{
+		int c = typelist.strchr (',');
+		if (c < 0) c = typelist.strlen();
+		if (c) ctypes.newval() = typelist.left (c);
+		typelist = typelist.mid (c+1);
+	}
+	store->setcompression (argv["--compress-min"], ctypes);
+	
+	if (nshards) reuseport::pin (0);
+	srv.start ();
+	for (int i=0; i<nshards; ++i)
+	{
+		fixedpages (*shards[i]);
+		if (bundle.count()) new bundlepage (*shards[i], bundle);
+		new MemStoreShard (*shards[i], *store);
+		reuseport::pin (i+1);
+		shards[i]->start ();
+	}
+	reuseport::unpin ();
+	
+	// A replica gets its expiries from the primary.
+	if (argv.exists ("--replica-of"))
+	{
+		store->setreadonly ();
+		new MemStoreReplica (*store, argv["--replica-of"]);
+	}
+	else
+	{
+		new MemStoreExpiry (*store);
+	}
+	
+	if (feedaddr)
+	{
+		store->setmaxlag (argv["--replica-maxlag"]);
+		int nslots = argv["--replica-slots"];
+		for (int i=0; i<nslots; ++i) new MemStoreFeed (*store, feedlistener);
+	}
+	
+	if (wireport)
+	{
+		int nthreads = argv["--wire-threads"];
+		for (int i=0; i<nthreads; ++i)
+		{
+			new MemStoreWire (wiregroup, *store, wirelistener);
+		}
+	}
+	
+	while (true)
+	{
+		value ev = waitevent ();
+		if (ev.type() == "shutdown") break;
+	}
+	
+	log::write (log::info, "main", "Stopping web service");
+	srv.shutdown ();
+	for (int i=0; i<nshards; ++i) shards[i]->shutdown ();
+	log::write (log::info, "main", "Shutting down log thread");
+	stoplog ();
+	
+	return 0;
+}
+
+//  =========================================================================
+/// Bytes currently allocated from the heap.
+//  =========================================================================
+static size_t heapbytes (void)
+{
+#if defined (__GLIBC__) && ((__GLIBC__ > 2) || (__GLIBC_MINOR__ >= 33))
+	struct mallinfo2 mi = mallinfo2 ();
+#else
+	struct mallinfo mi = mallinfo ();
+#endif
+	return (size_t) mi.uordblks + (size_t) mi.hblkhd;
+}
+
+// ==========================================================================
+// METHOD MemStoreDaemon::fixedpages
+// ==========================================================================
+void MemStoreDaemon::fixedpages (httpd &h)
+{
+	new StaticPage (h, "/_health", "text/plain", "OK\n");
+	new ExecutePage (h, "/_page/health", "text/plain", "OK\n");
+	new StaticPage (h, "/_banner", "text/html", MEMSTORED_BANNER);
+	new ExecutePage (h, "/_page/banner", "text/html", MEMSTORED_BANNER);
+}
+
+// ==========================================================================
+// METHOD MemStoreDaemon::memtest
+// ==========================================================================
+void MemStoreDaemon::memtest (int n)
+{
+	const char *ctypes[3] = { "application/json", "text/plain", "text/html" };
+	if (n < 1) n = 1;
+	
+	// The layout MemStore used to keep: a dict of small dicts.
+	size_t base = heapbytes ();
+	value *plain = new value;
+	for (int i=0; i<n; ++i)
+	{
+		(*plain)["/bench/%08i" %format (i)] =
+			$("Content-type", ctypes[i%3]) ->
+			$("data", "{\"n\":%i}" %format (i));
+	}
+	double before = (double) (heapbytes () - base) / n;
+	delete plain;
+	
+	base = heapbytes ();
+	EntryStore *compact = new EntryStore;
+	for (int i=0; i<n; ++i)
+	{
+		compact->set ("/bench/%08i" %format (i), ctypes[i%3],
+					  "{\"n\":%i}" %format (i), 0);
+	}
+	double after = (double) (heapbytes () - base) / n;
+	value usage = compact->usage ();
+	delete compact;
+	
+	fout.writeln ("entries:            %i" %format (n));
+	fout.writeln ("value dict:         %.1f bytes/entry" %format (before));
+	fout.writeln ("EntryStore:         %.1f bytes/entry" %format (after));
+	fout.writeln ("EntryStore (own):   %.1f bytes/entry"
+				  %format (usage["bytesperentry"].dval()));
+}
+
+$appobject (MemStoreDaemon);
+$version (1.0);
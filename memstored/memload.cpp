@@ -0,0 +1,266 @@
+#include "memload.h"
+#include "wire.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+$appobject(memloadApp);
+
+//  -------------------------------------------------------------------------
+/// Arguments for a client thread.
+//  -------------------------------------------------------------------------
+struct loadarg
+{
+	memloadApp		*app; ///< The application.
+	int				 id; ///< The thread number.
+	bool			 started; ///< True if the thread was created.
+};
+
+//  =========================================================================
+/// Thread entry point for a client.
+//  =========================================================================
+static void *loadworker (void *arg)
+{
+	loadarg *a = (loadarg *) arg;
+	a->app->work (a->id);
+	return NULL;
+}
+
+//  =========================================================================
+/// Current time in microseconds.
+//  =========================================================================
+static long long loadnow (void)
+{
+	struct timeval tv;
+	gettimeofday (&tv, NULL);
+	return ((long long) tv.tv_sec * 1000000) + tv.tv_usec;
+}
+
+//  =========================================================================
+/// Sort order for latencies.
+//  =========================================================================
+static int cmpusec (const void *a, const void *b)
+{
+	return *((const int *) a) - *((const int *) b);
+}
+
+// ==========================================================================
+// METHOD memloadApp::main
+// ==========================================================================
+int memloadApp::main (void)
+{
+	host = argv["--host"].sval();
+	port = argv["--port"];
+	wireport = argv["--wire-port"];
+	nthreads = argv["--threads"];
+	nrequests = argv["--requests"];
+	if (nthreads < 1) nthreads = 1;
+	if (nrequests < 1) nrequests = 1;
+
+	fout.writeln ("%i threads, %i requests each" %format (nthreads,
+				  nrequests));
+
+	caseselector (argv["--compare"])
+	{
+		incaseof ("static") :
+			measure ("StaticPage /_health", LOAD_HTTP, "/_health");
+			measure ("serverpage /_page/health", LOAD_HTTP, "/_page/health");
+			measure ("StaticPage /_banner", LOAD_HTTP, "/_banner");
+			measure ("serverpage /_page/banner", LOAD_HTTP, "/_page/banner");
+			break;
+
+		incaseof ("protocol") :
+			if (! wireport)
+			{
+				ferr.writeln ("% The protocol comparison needs --wire-port");
+				return 1;
+			}
+			if (! preparedoc ("/memload/doc")) return 1;
+			measure ("HTTP GET", LOAD_HTTP, "/memload/doc");
+			measure ("binary GET, kept connection", LOAD_WIRE, "/memload/doc");
+			measure ("binary GET, new connection", LOAD_WIRECONN,
+					 "/memload/doc");
+			httpreq ("DELETE", "/memload/doc");
+			break;
+
+		defaultcase :
+			ferr.writeln ("%% Unknown comparison: %s"
+						  %format (argv["--compare"]));
+			return 1;
+	}
+
+	return 0;
+}
+
+// ==========================================================================
+// METHOD memloadApp::measure
+// ==========================================================================
+void memloadApp::measure (const string &name, int how, const string &path)
+{
+	kind = how;
+	target = path;
+	failed = unconnected = 0;
+	usec = new int[nthreads * nrequests];
+
+	pthread_t *threads = new pthread_t[nthreads];
+	loadarg *args = new loadarg[nthreads];
+	long long tstart = loadnow ();
+
+	for (int i=0; i<nthreads; ++i)
+	{
+		args[i].app = this;
+		args[i].id = i;
+		args[i].started = (pthread_create (&threads[i], NULL,
+										   loadworker, &args[i]) == 0);
+		if (! args[i].started) loadworker (&args[i]);
+	}
+	for (int i=0; i<nthreads; ++i)
+	{
+		if (args[i].started) pthread_join (threads[i], NULL);
+	}
+
+	double t = (loadnow () - tstart) / 1000000.0;
+	int total = nthreads * nrequests;
+	qsort (usec, total, sizeof (int), cmpusec);
+
+	// Requests of threads that couldn't connect are marked -1 and sort
+	// to the front.
+	int skipped = 0;
+	while ((skipped < total) && (usec[skipped] < 0)) skipped++;
+	int *ran = usec + skipped;
+	total -= skipped;
+
+	if (unconnected)
+	{
+		ferr.writeln ("%% %s: %i threads could not connect, %i requests "
+					  "not made" %format (name, unconnected, skipped));
+	}
+
+	if (total)
+	{
+		fout.writeln ("%s: %i requests, %i failed, %.2fs, %.0f req/s"
+					  %format (name, total, failed, t, total / t));
+		fout.writeln ("   p50 %i us, p99 %i us, max %i us"
+					  %format (ran[total/2], ran[(total*99)/100],
+							   ran[total-1]));
+	}
+
+	delete[] usec;
+	delete[] threads;
+	delete[] args;
+	usec = NULL;
+}
+
+// ==========================================================================
+// METHOD memloadApp::work
+// ==========================================================================
+void memloadApp::work (int id)
+{
+	int *mine = usec + (id * nrequests);
+	tcpsocket kept;
+	if ((kind == LOAD_WIRE) && (! kept.connect (host, wireport)))
+	{
+		for (int i=0; i<nrequests; ++i) mine[i] = -1;
+		__atomic_add_fetch (&unconnected, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	for (int i=0; i<nrequests; ++i)
+	{
+		long long t0 = loadnow ();
+		bool ok;
+		if (kind == LOAD_HTTP)
+		{
+			ok = (httpreq ("GET", target) == 200);
+		}
+		else if (kind == LOAD_WIRE)
+		{
+			ok = wireget (kept, target);
+		}
+		else
+		{
+			tcpsocket s;
+			ok = s.connect (host, wireport) && wireget (s, target);
+			s.close ();
+		}
+		mine[i] = (int) (loadnow () - t0);
+		if (! ok) __atomic_add_fetch (&failed, 1, __ATOMIC_RELAXED);
+	}
+
+	if (kind == LOAD_WIRE) kept.close ();
+}
+
+// ==========================================================================
+// METHOD memloadApp::httpreq
+// ==========================================================================
+int memloadApp::httpreq (const string &method, const string &path,
+						 const string &body)
+{
+	tcpsocket s;
+	if (! s.connect (host, port)) return 0;
+
+	string req = "%s %s HTTP/1.0\r\nHost: %s\r\n" %format (method, path,
+				 host);
+	if (body.strlen())
+	{
+		req.strcat ("Content-type: text/plain\r\n");
+		req.strcat ("Content-length: %i\r\n" %format (body.strlen()));
+	}
+	req.strcat ("\r\n");
+	req.strcat (body);
+
+	int status = 0;
+	if (s.puts (req))
+	{
+		string line = s.gets ();
+		line.cutat (' ');
+		string code = line.cutat (' ');
+		status = atoi (code.str());
+		while (! s.eof ()) s.read (16384);
+	}
+
+	s.close ();
+	return status;
+}
+
+// ==========================================================================
+// METHOD memloadApp::wireget
+// ==========================================================================
+bool memloadApp::wireget (tcpsocket &s, const string &key)
+{
+	string frame;
+	putint (frame, 9 + key.strlen(), 4);
+	frame.strcat ('G');
+	putint (frame, key.strlen(), 2);
+	putint (frame, 0, 2);
+	putint (frame, 0, 4);
+	frame.strcat (key);
+	if (! s.puts (frame)) return false;
+
+	string hdr = s.read (4);
+	if (hdr.strlen() < 4) return false;
+	unsigned int len = getint (hdr, 0, 4);
+	if (len < 4) return false;
+
+	string reply = s.read (len);
+	if (reply.strlen() < len) return false;
+	return (getint (reply, 0, 2) == 200);
+}
+
+// ==========================================================================
+// METHOD memloadApp::preparedoc
+// ==========================================================================
+bool memloadApp::preparedoc (const string &key)
+{
+	int sz = argv["--size"];
+	string doc;
+	for (int i=0; i<sz; ++i) doc.strcat ((char) ('a' + (i % 26)));
+
+	httpreq ("DELETE", key);
+	if (httpreq ("PUT", key, doc) != 200)
+	{
+		ferr.writeln ("%% Could not store %s" %format (key));
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,123 @@
+#ifndef _memstored_memload_H
+#define _memstored_memload_H 1
+#include <grace/application.h>
+#include <grace/tcpsocket.h>
+
+/// How a test gets its answers.
+#define LOAD_HTTP 0 ///< HTTP GET, a connection per request.
+#define LOAD_WIRE 1 ///< Binary protocol, a connection per thread.
+#define LOAD_WIRECONN 2 ///< Binary protocol, a connection per request.
+
+//  -------------------------------------------------------------------------
+/// Load generator for memstored. Runs the same number of requests from
+/// a pool of client threads against two ways of getting an answer and
+/// prints the throughput and latency of each, so the fast paths of the
+/// daemon can be checked against the path they replace. The binary
+/// protocol is measured with a connection kept per thread, the way its
+/// clients use it, and with a connection per request, to tell the cost
+/// of HTTP apart from the cost of connecting.
+//  -------------------------------------------------------------------------
+class memloadApp : public application
+{
+public:
+		 	 memloadApp (void) :
+				application ("nl.madscience.tools.memload")
+			 {
+			 	opt = $("-H", $("long", "--host")) ->
+			 		  $("-p", $("long", "--port")) ->
+			 		  $("-t", $("long", "--threads")) ->
+			 		  $("-w", $("long", "--wire-port")) ->
+			 		  $("-n", $("long", "--requests")) ->
+			 		  $("-s", $("long", "--size")) ->
+			 		  $("-c", $("long", "--compare")) ->
+			 		  $("-h", $("long", "--help")) ->
+			 		  $("--host",
+			 		  		$("argc", 1) ->
+			 		  		$("default", "127.0.0.1") ->
+			 		  		$("help", "Host running memstored")
+			 		   ) ->
+			 		  $("--port",
+			 		  		$("argc", 1) ->
+			 		  		$("default", 1135) ->
+			 		  		$("help", "HTTP port of memstored")
+			 		   ) ->
+			 		  $("--wire-port",
+			 		  		$("argc", 1) ->
+			 		  		$("default", 0) ->
+			 		  		$("help", "Binary protocol port of memstored")
+			 		   ) ->
+			 		  $("--size",
+			 		  		$("argc", 1) ->
+			 		  		$("default", 256) ->
+			 		  		$("help", "Size of the document fetched by the "
+			 		  				  "protocol comparison")
+			 		   ) ->
+			 		  $("--threads",
+			 		  		$("argc", 1) ->
+			 		  		$("default", 8) ->
+			 		  		$("help", "Client threads")
+			 		   ) ->
+			 		  $("--requests",
+			 		  		$("argc", 1) ->
+			 		  		$("default", 2000) ->
+			 		  		$("help", "Requests per thread per test")
+			 		   ) ->
+			 		  $("--compare",
+			 		  		$("argc", 1) ->
+			 		  		$("default", "static") ->
+			 		  		$("help", "What to compare: static (StaticPage "
+			 		  				  "against a serverpage, for the health "
+			 		  				  "check and the banner) or protocol "
+			 		  				  "(HTTP against the binary protocol)")
+			 		   );
+			 	usec = NULL;
+			 	failed = unconnected = 0;
+			 }
+			~memloadApp (void)
+			 {
+			 }
+
+	int		 main (void);
+
+			 /// Client thread body, runs its share of the current test.
+			 /// \param id The thread number.
+	void	 work (int id);
+
+protected:
+			 /// Runs one test on all threads and prints its numbers.
+			 /// \param name Label for the output.
+			 /// \param how LOAD_HTTP, LOAD_WIRE or LOAD_WIRECONN.
+			 /// \param path The path or key to GET.
+	void	 measure (const string &name, int how, const string &path);
+
+			 /// One HTTP request on a fresh connection, like a
+			 /// browser or a health checker makes it.
+			 /// \param method The method.
+			 /// \param path The path.
+			 /// \param body Data for PUT.
+			 /// \return The status, 0 if the request failed.
+	int		 httpreq (const string &method, const string &path,
+					  const string &body = "");
+
+			 /// One binary protocol GET.
+			 /// \param s A connected socket.
+			 /// \param key The key.
+			 /// \return False unless the status was 200.
+	bool	 wireget (tcpsocket &s, const string &key);
+
+			 /// Store the document for the protocol comparison.
+	bool	 preparedoc (const string &key);
+
+	string	 host; ///< Server host.
+	int		 port; ///< Server HTTP port.
+	int		 wireport; ///< Server binary protocol port.
+	int		 nthreads; ///< Client threads.
+	int		 nrequests; ///< Requests per thread.
+	int		 kind; ///< How the current test gets its answers.
+	string	 target; ///< Path or key of the current test.
+	int		*usec; ///< Latencies of the current test, by thread.
+	int		 failed; ///< Failed requests in the current test.
+	int		 unconnected; ///< Threads that couldn't connect.
+};
+
+#endif
@@ -0,0 +1,637 @@
+#include "memstore.h"
+#include "replication.h"
+#include "httpdstats.h"
+#include "../common/acceptencoding.h"
+#include <grace/daemon.h>
+#include <grace/lock.h>
+#include <string.h>
+#include <zlib.h>
+#include <sys/time.h>
+
+// ==========================================================================
+// CONSTRUCTOR MemStore
+// ==========================================================================
+MemStore::MemStore (httpd &srv)
+	: httpdobject (srv, "*")
+{
+	readonly = false;
+	seq = 0;
+	nfeeds = 0;
+	maxlag = 0;
+	compressmin = 0;
+}
+
+// ==========================================================================
+// DESTRUCTOR MemStore
+// ==========================================================================
+MemStore::~MemStore (void)
+{
+}
+
+// ==========================================================================
+// METHOD MemStore::get
+// ==========================================================================
+bool MemStore::get (const statstring &uri, value &into, bool acceptgzip)
+{
+	time_t now = time (NULL);
+	bool found = false;
+	
+	{
+		timedsection<EntryStore> in (db, HTTPDSTATS_SHARED);
+		// Keys past their deadline may not have been collected yet.
+		const memslot *ent = db.o.find (uri.sval());
+		if (ent && (! expired (ent, now)))
+		{
+			db.o.copyout (ent, into);
+			found = true;
+		}
+	}
+	
+	// Inflate outside the lock, it's a copy.
+	if (found && (! acceptgzip)) unpack (into);
+	return found;
+}
+
+// ==========================================================================
+// METHOD MemStore::put
+// ==========================================================================
+value *MemStore::put (const statstring &uri, const value &dat, int ttl)
+{
+	returnclass (value) res retain;
+	time_t now = time (NULL);
+	int expires = (ttl > 0) ? (int) (now + ttl) : 0;
+	value v = dat;
+	if (expires) v["expires"] = expires;
+	
+	value doc = dat;
+	pack (doc);
+	
+	{
+		timedsection<EntryStore> in (db, HTTPDSTATS_EXCLUSIVE);
+		const memslot *ent = db.o.find (uri.sval());
+		if (ent && (! expired (ent, now)))
+		{
+			res = $("ok", false) -> $("error", "Resource exists");
+		}
+		else if (db.o.set (uri.sval(), doc["Content-type"].sval(),
+						   doc["data"].sval(), expires,
+						   doc.exists ("Content-encoding")))
+		{
+			publish ($("op", "set") -> $("key", uri) -> $("value", v));
+			res = $("ok", true);
+		}
+		else
+		{
+			res = $("ok", false) -> $("error", "Key too long");
+		}
+	}
+	
+	if ((ttl > 0) && res["ok"]) wheel.schedule (uri, now + ttl);
+	return &res;
+}
+
+// ==========================================================================
+// METHOD MemStore::post
+// ==========================================================================
+value *MemStore::post (const statstring &uri, const value &dat, int ttl)
+{
+	returnclass (value) res retain;
+	time_t now = time (NULL);
+	int expires = (ttl > 0) ? (int) (now + ttl) : 0;
+	value v = dat;
+	if (expires) v["expires"] = expires;
+	
+	value doc = dat;
+	pack (doc);
+	
+	{
+		timedsection<EntryStore> in (db, HTTPDSTATS_EXCLUSIVE);
+		const memslot *ent = db.o.find (uri.sval());
+		if (ent && (! expired (ent, now)))
+		{
+			db.o.set (uri.sval(), doc["Content-type"].sval(),
+					  doc["data"].sval(), expires,
+					  doc.exists ("Content-encoding"));
+			publish ($("op", "set") -> $("key", uri) -> $("value", v));
+			res = $("ok", true);
+		}
+		else
+		{
+			res = $("ok", false) -> $("error", "Resource not found");
+		}
+	}
+	
+	if ((ttl > 0) && res["ok"]) wheel.schedule (uri, now + ttl);
+	return &res;
+}
+
+// ==========================================================================
+// METHOD MemStore::del
+// ==========================================================================
+value *MemStore::del (const statstring &uri)
+{
+	returnclass (value) res retain;
+	time_t now = time (NULL);
+	
+	{
+		timedsection<EntryStore> in (db, HTTPDSTATS_EXCLUSIVE);
+		const memslot *ent = db.o.find (uri.sval());
+		if (ent && (! expired (ent, now)))
+		{
+			db.o.remove (uri.sval());
+			publish ($("op", "del") -> $("key", uri));
+			res = $("ok", true);
+		}
+		else
+		{
+			res = $("ok", false) -> $("error", "Resource not found");
+		}
+	}
+	
+	return &res;
+}
+
+// ==========================================================================
+// METHOD MemStore::expire
+// ==========================================================================
+int MemStore::expire (void)
+{
+	value due = wheel.advance (time (NULL));
+	int removed = 0;
+	int i = 0;
+	
+	while (i < due.count())
+	{
+		timedsection<EntryStore> in (db, HTTPDSTATS_EXCLUSIVE);
+		for (int n=0; (n<64) && (i<due.count()); ++n, ++i)
+		{
+			// The wheel isn't told about overwrites and deletes;
+			// only remove the key if it still has this deadline.
+			const value &d = due[i];
+			string key = d["key"].sval();
+			const memslot *ent = db.o.find (key);
+			if (ent && (ent->expires == d["at"].ival()))
+			{
+				db.o.remove (key);
+				publish ($("op", "del") -> $("key", key));
+				removed++;
+			}
+		}
+	}
+	
+	// Lets replicas measure their lag while nothing changes.
+	{
+		timedsection<EntryStore> in (db, HTTPDSTATS_SHARED);
+		publish ($("op", "ping"));
+	}
+	
+	return removed;
+}
+
+// ==========================================================================
+// METHOD MemStore::expired
+// ==========================================================================
+bool MemStore::expired (const memslot *ent, time_t now)
+{
+	if (! ent->expires) return false;
+	return (ent->expires <= now);
+}
+
+// ==========================================================================
+// METHOD MemStore::addfeed
+// ==========================================================================
+void MemStore::addfeed (MemStoreFeed *f)
+{
+	if (nfeeds == MAXFEEDS) return;
+	f->id = nfeeds;
+	feeds[nfeeds++] = f;
+}
+
+// ==========================================================================
+// METHOD MemStore::subscribe
+// ==========================================================================
+value *MemStore::subscribe (int id)
+{
+	returnclass (value) res retain;
+	
+	{
+		timedsection<EntryStore> in (db, HTTPDSTATS_SHARED);
+		value snap = db.o.dump ();
+		res = $("op", "snapshot") ->
+			  $("seq", seq) ->
+			  $("time", now ()) ->
+			  $("db", snap);
+			  
+		feeds[id]->attached (seq);
+		exclusivesection (subscribed)
+		{
+			subscribed["%i" %format (id)] = id;
+		}
+	}
+	
+	// Replicas get plain documents and apply their own policy.
+	value &snapdb = res["db"];
+	for (int i=0; i<snapdb.count(); ++i) unpack (snapdb[i]);
+	
+	return &res;
+}
+
+// ==========================================================================
+// METHOD MemStore::unsubscribe
+// ==========================================================================
+void MemStore::unsubscribe (int id)
+{
+	exclusivesection (subscribed)
+	{
+		subscribed.rmval ("%i" %format (id));
+	}
+}
+
+// ==========================================================================
+// METHOD MemStore::publish
+// ==========================================================================
+void MemStore::publish (const value &msg)
+{
+	value m = msg;
+	if (m["op"] != "ping") seq++;
+	m["seq"] = seq;
+	m["time"] = now ();
+	
+	value behind;
+	sharedsection (subscribed)
+	{
+		foreach (feed, subscribed)
+		{
+			MemStoreFeed *f = feeds[feed.ival()];
+			if (maxlag && (f->lag (seq) > maxlag))
+			{
+				behind.newval() = feed.ival();
+				continue;
+			}
+			f->sendevent ("message", m);
+		}
+	}
+	
+	foreach (id, behind)
+	{
+		unsubscribe (id.ival());
+		feeds[id.ival()]->cut ();
+	}
+}
+
+// ==========================================================================
+// METHOD MemStore::apply
+// ==========================================================================
+void MemStore::apply (const value &msg)
+{
+	// Compress before taking the lock.
+	value m = msg;
+	if (m["op"] == "set") pack (m["value"]);
+	else if (m["op"] == "snapshot")
+	{
+		value &snapdb = m["db"];
+		for (int i=0; i<snapdb.count(); ++i) pack (snapdb[i]);
+	}
+	
+	{
+		timedsection<EntryStore> in (db, HTTPDSTATS_EXCLUSIVE);
+		caseselector (m["op"])
+		{
+			incaseof ("snapshot") :
+				db.o.load (m["db"]);
+				break;
+			
+			incaseof ("set") :
+				db.o.set (m["key"].sval(),
+						  m["value"]["Content-type"].sval(),
+						  m["value"]["data"].sval(),
+						  m["value"]["expires"].ival(),
+						  m["value"].exists ("Content-encoding"));
+				break;
+			
+			incaseof ("del") :
+				db.o.remove (m["key"].sval());
+				break;
+			
+			defaultcase :
+				break;
+		}
+	}
+	
+	double t = now ();
+	exclusivesection (repstate)
+	{
+		repstate["connected"] = true;
+		repstate["seq"] = msg["seq"];
+		repstate["lag"] = t - msg["time"].dval();
+		repstate["received"] = t;
+	}
+}
+
+// ==========================================================================
+// METHOD MemStore::disconnected
+// ==========================================================================
+void MemStore::disconnected (void)
+{
+	exclusivesection (repstate)
+	{
+		repstate["connected"] = false;
+	}
+}
+
+// ==========================================================================
+// METHOD MemStore::replication
+// ==========================================================================
+value *MemStore::replication (void)
+{
+	returnclass (value) res retain;
+	
+	if (! readonly)
+	{
+		res["role"] = "primary";
+		{
+			timedsection<EntryStore> in (db, HTTPDSTATS_SHARED);
+			res["seq"] = seq;
+		}
+		sharedsection (subscribed)
+		{
+			res["replicas"] = subscribed.count();
+		}
+		return &res;
+	}
+	
+	// Lag is the delivery delay of the last message; idle says how
+	// long ago that was, pings keep it under a second while connected.
+	res["role"] = "replica";
+	sharedsection (repstate)
+	{
+		res["connected"] = repstate["connected"].bval();
+		res["seq"] = repstate["seq"];
+		res["lag"] = repstate["lag"];
+		res["idle"] = now () - repstate["received"].dval();
+	}
+	return &res;
+}
+
+// ==========================================================================
+// METHOD MemStore::now
+// ==========================================================================
+double MemStore::now (void)
+{
+	struct timeval tv;
+	gettimeofday (&tv, NULL);
+	return tv.tv_sec + (tv.tv_usec / 1000000.0);
+}
+
+// ==========================================================================
+// METHOD MemStore::setcompression
+// ==========================================================================
+void MemStore::setcompression (int minsize, const value &types)
+{
+	compressmin = minsize;
+	compresstypes = types;
+}
+
+//  =========================================================================
+/// Gzips a buffer.
+/// \return False if zlib fails.
+//  =========================================================================
+static bool gzipdata (const string &in, string &into)
+{
+	z_stream z;
+	memset (&z, 0, sizeof (z));
+	if (deflateInit2 (&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 31, 8,
+					  Z_DEFAULT_STRATEGY) != Z_OK) return false;
+	
+	z.next_in = (Bytef *) in.str();
+	z.avail_in = in.strlen();
+	
+	char buf[16384];
+	int rc;
+	do
+	{
+		z.next_out = (Bytef *) buf;
+		z.avail_out = sizeof (buf);
+		rc = deflate (&z, Z_FINISH);
+		if (rc == Z_STREAM_ERROR) break;
+		into.strcat (buf, sizeof (buf) - z.avail_out);
+	} while (rc != Z_STREAM_END);
+	
+	deflateEnd (&z);
+	return (rc == Z_STREAM_END);
+}
+
+//  =========================================================================
+/// Inflates a gzipped buffer.
+/// \return False if the data is damaged.
+//  =========================================================================
+static bool gunzipdata (const string &in, string &into)
+{
+	z_stream z;
+	memset (&z, 0, sizeof (z));
+	if (inflateInit2 (&z, 31) != Z_OK) return false;
+	
+	z.next_in = (Bytef *) in.str();
+	z.avail_in = in.strlen();
+	
+	char buf[16384];
+	int rc;
+	do
+	{
+		z.next_out = (Bytef *) buf;
+		z.avail_out = sizeof (buf);
+		rc = inflate (&z, Z_NO_FLUSH);
+		if ((rc != Z_OK) && (rc != Z_STREAM_END)) break;
+		into.strcat (buf, sizeof (buf) - z.avail_out);
+	} while (rc != Z_STREAM_END);
+	
+	inflateEnd (&z);
+	return (rc == Z_STREAM_END);
+}
+
+// ==========================================================================
+// METHOD MemStore::pack
+// ==========================================================================
+void MemStore::pack (value &doc)
+{
+	if ((! compressmin) || doc.exists ("Content-encoding")) return;
+	
+	const string &data = doc["data"].sval();
+	if ((int) data.strlen() < compressmin) return;
+	
+	const string &ctype = doc["Content-type"].sval();
+	bool match = false;
+	foreach (prefix, compresstypes)
+	{
+		const string &p = prefix.sval();
+		string head = ctype.left (p.strlen());
+		if (head == p) match = true;
+	}
+	if (! match) return;
+	
+	// Already compressed formats that slip through the policy don't
+	// get smaller, keep those as they are.
+	string gz;
+	if (! gzipdata (data, gz)) return;
+	if (gz.strlen() >= data.strlen()) return;
+	
+	doc["data"] = gz;
+	doc["Content-encoding"] = "gzip";
+}
+
+// ==========================================================================
+// METHOD MemStore::unpack
+// ==========================================================================
+void MemStore::unpack (value &doc)
+{
+	if (! doc.exists ("Content-encoding")) return;
+	
+	string plain;
+	if (! gunzipdata (doc["data"].sval(), plain))
+	{
+		log::write (log::error, "memstore", "Stored document fails "
+					"to inflate");
+		return;
+	}
+	
+	doc["data"] = plain;
+	doc.rmval ("Content-encoding");
+}
+
+// ==========================================================================
+// METHOD MemStore::run
+// ==========================================================================
+int MemStore::run (string &uri, string &postbody, value &inhdr,
+				   string &out, value &outhdr, value &env,
+				   tcpsocket &s)
+{
+	requesttimer t (httpdstats::method (env));
+	value v;
+	outhdr["Content-type"] = "application/json";
+	
+	if (uri == "/_stats")
+	{
+		v = httpdstats::report ();
+		{
+			timedsection<EntryStore> in (db, HTTPDSTATS_SHARED);
+			v["store"] = db.o.usage ();
+		}
+		out = v.tojson ();
+		return 200;
+	}
+	
+	if (uri == "/_replication")
+	{
+		v = replication ();
+		out = v.tojson ();
+		return 200;
+	}
+	
+	if (uri == "/_memory")
+	{
+		{
+			timedsection<EntryStore> in (db, HTTPDSTATS_SHARED);
+			v = db.o.usage ();
+		}
+		out = v.tojson ();
+		return 200;
+	}
+	
+	if (readonly && (env["method"] != "GET"))
+	{
+		v = $("ok",false) -> $("error","Read-only replica");
+		out = v.tojson ();
+		return 405;
+	}
+	
+	caseselector (env["method"])
+	{
+		incaseof ("GET") :
+			if (get (uri, v, inhdr.exists ("Accept-encoding") &&
+					 acceptencoding::gzip (inhdr["Accept-encoding"].sval())))
+			{
+				outhdr["Content-type"] = v["Content-type"];
+				if (v.exists ("Content-encoding"))
+				{
+					outhdr["Content-encoding"] = v["Content-encoding"];
+				}
+				if (compressing ()) outhdr["Vary"] = "Accept-encoding";
+				out = v["data"].sval();
+				return 200;
+			}
+			
+			v = $("ok",false) -> $("error","Not found");
+			out = v.tojson ();
+			return 404;
+		
+		incaseof ("POST") :
+			v = $("Content-type",inhdr["Content-type"]) ->
+				$("data", postbody);
+			
+			v = post (uri, v, inhdr["X-ttl"].ival());
+			out = v.tojson ();
+			
+			log::write (log::info, "memstore", "%P update <%s>"
+						%format (env["ip"], uri));
+						
+			return v["ok"] ? 200 : 404;
+			
+		incaseof ("PUT") :
+			v = $("Content-type",inhdr["Content-type"]) ->
+				$("data", postbody);
+			
+			v = put (uri, v, inhdr["X-ttl"].ival());
+			out = v.tojson ();
+
+			log::write (log::info, "memstore", "%P store <%s>"
+						%format (env["ip"], uri));
+			
+			return v["ok"] ? 200 : 405;
+		
+		incaseof ("DELETE") :
+			v = del (uri);
+			out = v.tojson ();
+
+			log::write (log::info, "memstore", "%P delete <%s>"
+						%format (env["ip"], uri));
+						
+			return v["ok"] ? 200 : 404;
+		
+		defaultcase :
+			return 500;
+		
+	}
+}
+
+// ==========================================================================
+// CONSTRUCTOR MemStoreExpiry
+// ==========================================================================
+MemStoreExpiry::MemStoreExpiry (MemStore &st)
+	: thread ("expiry"), store (st)
+{
+	spawn ();
+}
+
+// ==========================================================================
+// DESTRUCTOR MemStoreExpiry
+// ==========================================================================
+MemStoreExpiry::~MemStoreExpiry (void)
+{
+}
+
+// ==========================================================================
+// METHOD MemStoreExpiry::run
+// ==========================================================================
+void MemStoreExpiry::run (void)
+{
+	while (true)
+	{
+		sleep (1);
+		int removed = store.expire ();
+		if (removed)
+		{
+			log::write (log::info, "memstore", "Expired %i keys"
+						%format (removed));
+		}
+	}
+}
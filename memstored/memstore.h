@@ -0,0 +1,168 @@
+#ifndef _memstored_memstore_H
+#define _memstored_memstore_H 1
+#include <grace/httpd.h>
+#include <grace/lock.h>
+#include <grace/thread.h>
+#include <time.h>
+#include "entrystore.h"
+#include "expirywheel.h"
+
+#define MAXFEEDS 8
+
+class MemStoreFeed;
+
+//  -------------------------------------------------------------------------
+/// HTTP handler object for a simple in-memor document store
+//  -------------------------------------------------------------------------
+class MemStore : public httpdobject
+{
+public:
+					 /// Constructor.
+					 /// \param srv Reference to parent httpd.
+					 MemStore (httpd &srv);
+					~MemStore (void);
+					
+					 /// Run-method.
+					 /// \param uri The request URI
+					 /// \param postbody Posted data
+					 /// \param inhdr Input headers
+					 /// \param out Output data
+					 /// \param outhdr Output headers
+					 /// \param env Meta-variables
+					 /// \param s Raw socket.
+	int				 run (string &uri, string &postbody, value &inhdr,
+						  string &out, value &outhdr, value &env,
+						  tcpsocket &s);
+						  
+					 /// Fetch a document.
+					 /// \param uri The key.
+					 /// \param into Receives Content-type and data.
+					 /// \param acceptgzip If true, a document stored
+					 ///        gzipped is returned as is, with a
+					 ///        Content-encoding. Otherwise it is
+					 ///        inflated first.
+	bool			 get (const statstring &uri, value &into,
+						  bool acceptgzip = false);
+	value			*put (const statstring &uri, const value &v,
+						  int ttl = 0);
+	value			*post (const statstring &uri, const value &v,
+						   int ttl = 0);
+	value			*del (const statstring &uri);
+	
+					 /// Remove the keys whose time has come. The write
+					 /// lock is taken for small batches at a time, so
+					 /// readers get in between.
+					 /// \return Number of keys removed.
+	int				 expire (void);
+	
+					 /// Set the compression policy for new documents.
+					 /// \param minsize Smallest document to gzip, 0
+					 ///        turns compression off.
+					 /// \param types Content type prefixes to gzip.
+	void			 setcompression (int minsize, const value &types);
+	bool			 compressing (void) { return compressmin > 0; }
+	
+					 /// Turn this store into a read-only replica.
+	void			 setreadonly (void) { readonly = true; }
+	bool			 isreadonly (void) { return readonly; }
+	
+					 /// Cut off replicas more than this many mutations
+					 /// behind, 0 never does.
+	void			 setmaxlag (int n) { maxlag = n; }
+	
+					 /// Register a replication feed thread.
+	void			 addfeed (MemStoreFeed *f);
+	
+					 /// Start sending mutations to a feed.
+					 /// \param id The feed's slot.
+					 /// \return Snapshot of the store, taken under the
+					 ///         same lock so no mutation falls between.
+	value			*subscribe (int id);
+	
+					 /// Stop sending mutations to a feed.
+	void			 unsubscribe (int id);
+	
+					 /// Apply a message from the primary (replica side).
+	void			 apply (const value &msg);
+	
+					 /// Note that the connection to the primary broke.
+	void			 disconnected (void);
+	
+					 /// Replication status, for /_replication.
+	value			*replication (void);
+	
+					 /// Current time with microseconds.
+	static double	 now (void);
+						  
+protected:
+					 /// Checks if an entry is past its deadline.
+	static bool		 expired (const memslot *ent, time_t now);
+	
+					 /// Send a message to all subscribed feeds. Called
+					 /// with the write lock on db held, so feeds see
+					 /// mutations in the order they were applied.
+	void			 publish (const value &msg);
+	
+					 /// Gzip a document if the policy says so and it
+					 /// gets smaller; sets its Content-encoding.
+	void			 pack (value &doc);
+	
+					 /// Inflate a document with a Content-encoding.
+	void			 unpack (value &doc);
+
+	lock<EntryStore> db; ///< The memory database.
+	ExpiryWheel		 wheel; ///< Deadlines of keys with a TTL.
+	bool			 readonly; ///< True on a replica.
+	int				 seq; ///< Sequence number of the last mutation.
+	MemStoreFeed	*feeds[MAXFEEDS]; ///< Replication feed threads.
+	int				 nfeeds; ///< Number of feed threads.
+	lock<value>		 subscribed; ///< Slots of the feeds with a replica.
+	int				 maxlag; ///< Mutations a replica may fall behind.
+	lock<value>		 repstate; ///< Replica side status.
+	int				 compressmin; ///< Smallest document to gzip, or 0.
+	value			 compresstypes; ///< Content type prefixes to gzip.
+};
+
+//  -------------------------------------------------------------------------
+/// Handler for the extra httpd shards, passes requests on to the one
+/// store.
+//  -------------------------------------------------------------------------
+class MemStoreShard : public httpdobject
+{
+public:
+					 MemStoreShard (httpd &srv, MemStore &st)
+					 	: httpdobject (srv, "*"), store (st)
+					 {
+					 }
+					~MemStoreShard (void)
+					 {
+					 }
+					 
+	int				 run (string &uri, string &postbody, value &inhdr,
+						  string &out, value &outhdr, value &env,
+						  tcpsocket &s)
+					 {
+					 	return store.run (uri, postbody, inhdr, out,
+					 					  outhdr, env, s);
+					 }
+
+protected:
+	MemStore		&store; ///< The store.
+};
+
+//  -------------------------------------------------------------------------
+/// Background thread that services the expiry wheel once a second.
+//  -------------------------------------------------------------------------
+class MemStoreExpiry : public thread
+{
+public:
+					 MemStoreExpiry (MemStore &st);
+					~MemStoreExpiry (void);
+					
+	void			 run (void);
+
+protected:
+	MemStore		&store; ///< The store to expire keys from.
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef _memstored_H
+#define _memstored_H 1
+#include <grace/daemon.h>
+#include <grace/httpd.h>
+#include <grace/lock.h>
+#include <grace/tcpsocket.h>
+#include <grace/thread.h>
+#include "../common/sitebundle.h"
+
+#define MAXSHARDS 64
+
+/// Served on /_banner, and on /_page/banner for memload to compare.
+#define MEMSTORED_BANNER \
+	"<html><head><title>memstored</title></head>\n" \
+	"<body><h1>memstored</h1><p>In-memory document store.</p></body>" \
+	"</html>\n"
+
+//  -------------------------------------------------------------------------
+/// Main daemon class.
+//  -------------------------------------------------------------------------
+class MemStoreDaemon : public daemon
+{
+public:
+					 MemStoreDaemon (void);
+					~MemStoreDaemon (void);
+					
+	int				 main (void);
+	
+					 /// Fill a plain value dict and an EntryStore with
+					 /// the same documents and print the heap bytes
+					 /// per entry each of them takes.
+					 /// \param n Number of documents.
+	void			 memtest (int n);
+	
+					 /// Add the health check and banner to an httpd,
+					 /// as StaticPage and through the serverpage path.
+					 /// \param h The httpd.
+	void			 fixedpages (httpd &h);
+	
+	httpd			 srv;
+	lock<tcplistener> wirelistener; ///< Binary protocol listener.
+	threadgroup		 wiregroup; ///< Binary protocol workers.
+	lock<tcplistener> feedlistener; ///< Replication listener.
+	httpd			*shards[MAXSHARDS]; ///< Extra listeners for --shards.
+	int				 nshards; ///< Number of extra listeners.
+	sitebundle		 bundle; ///< Site bundle served with --bundle.
+};
+
+#endif
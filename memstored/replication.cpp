@@ -0,0 +1,212 @@
+#include "replication.h"
+#include "wire.h"
+#include <grace/daemon.h>
+#include <sys/socket.h>
+
+//  =========================================================================
+/// Sends a replication message as a length-prefixed JSON frame.
+//  =========================================================================
+static bool sendframe (tcpsocket &s, const value &msg)
+{
+	string json = msg.tojson ();
+	if (json.strlen() > REPLICATION_MAXFRAME)
+	{
+		log::write (log::error, "replica", "Message of %i bytes is "
+					"over the frame limit" %format (json.strlen()));
+		return false;
+	}
+	
+	string frame;
+	putint (frame, json.strlen(), 4);
+	frame.strcat (json);
+	return s.puts (frame);
+}
+
+//  =========================================================================
+/// Reads a replication frame.
+//  =========================================================================
+static bool readframe (tcpsocket &s, value &into)
+{
+	string hdr = s.read (4);
+	if (hdr.strlen() < 4) return false;
+	
+	unsigned int len = getint (hdr, 0, 4);
+	if (len > REPLICATION_MAXFRAME)
+	{
+		log::write (log::error, "replica", "Frame over the %i byte "
+					"limit, dropping the connection"
+					%format (REPLICATION_MAXFRAME));
+		return false;
+	}
+	
+	string json = s.read (len);
+	if (json.strlen() < len) return false;
+	
+	into.fromjson (json);
+	return true;
+}
+
+// ==========================================================================
+// CONSTRUCTOR MemStoreFeed
+// ==========================================================================
+MemStoreFeed::MemStoreFeed (MemStore &st, lock<tcplistener> &l)
+	: thread ("feed"), store (st), listener (l)
+{
+	id = -1;
+	sentseq = 0;
+	cutoff = false;
+	sockfd.o = -1;
+	store.addfeed (this);
+	if (id >= 0) spawn ();
+}
+
+// ==========================================================================
+// DESTRUCTOR MemStoreFeed
+// ==========================================================================
+MemStoreFeed::~MemStoreFeed (void)
+{
+}
+
+// ==========================================================================
+// METHOD MemStoreFeed::run
+// ==========================================================================
+void MemStoreFeed::run (void)
+{
+	while (true)
+	{
+		tcpsocket s;
+		exclusivesection (listener)
+		{
+			s = listener.o.accept ();
+		}
+		exclusivesection (sockfd)
+		{
+			sockfd.o = s.filno ();
+		}
+		
+		value snapshot = store.subscribe (id);
+		int since = snapshot["seq"];
+		bool ok = sendframe (s, snapshot);
+		
+		log::write (log::info, "replica", "Replica attached at "
+					"seq %i" %format (since));
+		
+		while (ok)
+		{
+			value ev = waitevent ();
+			if (__atomic_load_n (&cutoff, __ATOMIC_RELAXED))
+			{
+				log::write (log::warning, "replica", "Replica fell too "
+							"far behind, cut off");
+				break;
+			}
+			
+			// Left in the queue from an earlier replica, the snapshot
+			// already has it.
+			if ((ev["op"] != "ping") && (ev["seq"].ival() <= since))
+			{
+				continue;
+			}
+			ok = sendframe (s, ev);
+			if (ok && (ev["op"] != "ping"))
+			{
+				__atomic_store_n (&sentseq, ev["seq"].ival(),
+								  __ATOMIC_RELAXED);
+			}
+		}
+		
+		store.unsubscribe (id);
+		exclusivesection (sockfd)
+		{
+			sockfd.o = -1;
+		}
+		s.close ();
+		log::write (log::info, "replica", "Replica detached");
+	}
+}
+
+// ==========================================================================
+// METHOD MemStoreFeed::attached
+// ==========================================================================
+void MemStoreFeed::attached (int seq)
+{
+	__atomic_store_n (&sentseq, seq, __ATOMIC_RELAXED);
+	__atomic_store_n (&cutoff, false, __ATOMIC_RELAXED);
+}
+
+// ==========================================================================
+// METHOD MemStoreFeed::lag
+// ==========================================================================
+int MemStoreFeed::lag (int seq)
+{
+	return seq - __atomic_load_n (&sentseq, __ATOMIC_RELAXED);
+}
+
+// ==========================================================================
+// METHOD MemStoreFeed::cut
+// ==========================================================================
+void MemStoreFeed::cut (void)
+{
+	__atomic_store_n (&cutoff, true, __ATOMIC_RELAXED);
+	exclusivesection (sockfd)
+	{
+		if (sockfd.o >= 0) ::shutdown (sockfd.o, SHUT_RDWR);
+	}
+}
+
+// ==========================================================================
+// CONSTRUCTOR MemStoreReplica
+// ==========================================================================
+MemStoreReplica::MemStoreReplica (MemStore &st, const string &target)
+	: thread ("replica"), store (st)
+{
+	primary = target;
+	spawn ();
+}
+
+// ==========================================================================
+// DESTRUCTOR MemStoreReplica
+// ==========================================================================
+MemStoreReplica::~MemStoreReplica (void)
+{
+}
+
+// ==========================================================================
+// METHOD MemStoreReplica::run
+// ==========================================================================
+void MemStoreReplica::run (void)
+{
+	while (true)
+	{
+		tcpsocket s;
+		bool connected;
+		
+		if (primary[0] == '/')
+		{
+			connected = s.uconnect (primary);
+		}
+		else
+		{
+			string port = primary;
+			string host = port.cutat (':');
+			value portnum = port;
+			connected = s.connect (host, portnum.ival());
+		}
+		
+		if (connected)
+		{
+			log::write (log::info, "replica", "Connected to %s"
+						%format (primary));
+			
+			value msg;
+			while (readframe (s, msg)) store.apply (msg);
+			s.close ();
+			
+			log::write (log::warning, "replica", "Lost connection "
+						"to %s" %format (primary));
+		}
+		
+		store.disconnected ();
+		sleep (1);
+	}
+}
@@ -0,0 +1,73 @@
+#ifndef _memstored_replication_H
+#define _memstored_replication_H 1
+#include <grace/tcpsocket.h>
+#include <grace/thread.h>
+#include <grace/lock.h>
+#include "memstore.h"
+
+/// Largest replication frame read or sent. A 64MB document can take
+/// several times its size as JSON, a longer length is taken to be
+/// garbage and drops the connection.
+#define REPLICATION_MAXFRAME 0x40000000
+
+//  -------------------------------------------------------------------------
+/// Primary side of replication. Feed threads take turns accepting a
+/// replica on the shared listener, send it a snapshot of the store and
+/// then every mutation as it happens, plus a ping once a second. Each
+/// message is a u32 length followed by a JSON object with op, seq and
+/// time (the primary's clock).
+///
+/// Mutations wait in the feed's event queue until the replica takes
+/// them. A replica that falls more than the store's lag limit behind
+/// is cut off, so a stuck one can't make the primary queue every
+/// mutation for it; it gets a fresh snapshot when it reconnects.
+//  -------------------------------------------------------------------------
+class MemStoreFeed : public thread
+{
+public:
+					 MemStoreFeed (MemStore &st, lock<tcplistener> &l);
+					~MemStoreFeed (void);
+					
+	void			 run (void);
+	
+					 /// Note the seq of the snapshot a new replica got.
+					 /// Called by the store under its lock.
+	void			 attached (int seq);
+	
+					 /// Number of mutations not yet sent.
+					 /// \param seq The store's current seq.
+	int				 lag (int seq);
+	
+					 /// Drop the replica; unblocks a send it isn't
+					 /// reading. Called by the store.
+	void			 cut (void);
+	
+	int				 id; ///< Slot in the store's feed table.
+
+protected:
+	MemStore		&store; ///< The store.
+	lock<tcplistener> &listener; ///< The listener shared by the feeds.
+	int				 sentseq; ///< Seq of the last mutation sent, atomic.
+	bool			 cutoff; ///< Set by cut(), atomic.
+	lock<int>		 sockfd; ///< Socket of the replica, or -1.
+};
+
+//  -------------------------------------------------------------------------
+/// Replica side of replication. Connects to a primary over TCP
+/// (host:port) or a unix socket (a path), applies what it receives and
+/// reconnects when the connection drops.
+//  -------------------------------------------------------------------------
+class MemStoreReplica : public thread
+{
+public:
+					 MemStoreReplica (MemStore &st, const string &target);
+					~MemStoreReplica (void);
+					
+	void			 run (void);
+
+protected:
+	MemStore		&store; ///< The store.
+	string			 primary; ///< Where to connect.
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef _GNU_SOURCE
+  #define _GNU_SOURCE 1
+#endif
+#include "reuseport.h"
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <dlfcn.h>
+
+/// True while the thread holds a reuseportscope.
+static __thread bool reuseportactive = false;
+
+// ==========================================================================
+// CONSTRUCTOR reuseportscope
+// ==========================================================================
+reuseportscope::reuseportscope (bool on)
+{
+	previous = reuseportactive;
+	if (on) reuseportactive = true;
+}
+
+// ==========================================================================
+// DESTRUCTOR reuseportscope
+// ==========================================================================
+reuseportscope::~reuseportscope (void)
+{
+	reuseportactive = previous;
+}
+
+// ==========================================================================
+// METHOD reuseportscope::active
+// ==========================================================================
+bool reuseportscope::active (void)
+{
+	return reuseportactive;
+}
+
+//  =========================================================================
+/// Wrapper around the C library's bind(), see reuseport. Outside a
+/// reuseportscope it only passes the call on.
+//  =========================================================================
+extern "C" int bind (int fd, const struct sockaddr *addr,
+					 socklen_t len) __THROW
+{
+	typedef int (*bindfunc)(int, const struct sockaddr *, socklen_t);
+	static bindfunc realbind = (bindfunc) dlsym (RTLD_NEXT, "bind");
+
+	if (reuseportactive && addr &&
+		((addr->sa_family == AF_INET) || (addr->sa_family == AF_INET6)))
+	{
+		int one = 1;
+		setsockopt (fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof (one));
+	}
+
+	return realbind (fd, addr, len);
+}
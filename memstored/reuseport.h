@@ -0,0 +1,92 @@
+#ifndef _memstored_reuseport_H
+#define _memstored_reuseport_H 1
+#ifndef _GNU_SOURCE
+  #define _GNU_SOURCE 1
+#endif
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+//  -------------------------------------------------------------------------
+/// Support for running several httpd instances on one port. The httpd
+/// class sets up its own listening socket, so SO_REUSEPORT is applied
+/// by a wrapper around bind() in reuseport.cpp, for the sockets bound
+/// while a reuseportscope is held by the same thread. The kernel then
+/// spreads new connections over the listeners. Each httpd's workers can
+/// be kept on a single core by pinning the thread that starts it;
+/// threads inherit the affinity of the thread that creates them.
+//  -------------------------------------------------------------------------
+class reuseport
+{
+public:
+					 /// Number of online cores.
+	static int		 cores (void)
+					 {
+					 	int n = sysconf (_SC_NPROCESSORS_ONLN);
+					 	return (n > 0) ? n : 1;
+					 }
+
+					 /// Pin the calling thread to the core for a shard.
+					 /// The original mask is kept for unpin().
+					 /// \param shard The shard number.
+	static void		 pin (int shard)
+					 {
+					 	cpu_set_t set;
+					 	if (! saved())
+					 	{
+					 		pthread_getaffinity_np (pthread_self(),
+					 								sizeof (cpu_set_t),
+					 								&original());
+					 		saved() = true;
+					 	}
+					 	CPU_ZERO (&set);
+					 	CPU_SET (shard % cores(), &set);
+					 	pthread_setaffinity_np (pthread_self(),
+					 							sizeof (cpu_set_t), &set);
+					 }
+
+					 /// Give the calling thread its original mask back.
+	static void		 unpin (void)
+					 {
+					 	if (! saved()) return;
+					 	pthread_setaffinity_np (pthread_self(),
+					 							sizeof (cpu_set_t),
+					 							&original());
+					 }
+
+protected:
+	static bool		&saved (void)
+					 {
+					 	static bool s = false;
+					 	return s;
+					 }
+
+	static cpu_set_t &original (void)
+					 {
+					 	static cpu_set_t set;
+					 	return set;
+					 }
+};
+
+//  -------------------------------------------------------------------------
+/// Sets SO_REUSEPORT on the TCP sockets the calling thread binds while
+/// the object exists. Only the listento() calls of the httpd shards go
+/// inside one; other listeners on the port are not to be shared.
+//  -------------------------------------------------------------------------
+class reuseportscope
+{
+public:
+					 /// Constructor.
+					 /// \param on False to leave bind() alone, for a
+					 ///        single listener.
+					 reuseportscope (bool on = true);
+					~reuseportscope (void);
+
+					 /// True if the calling thread is inside a scope.
+	static bool		 active (void);
+
+protected:
+	bool			 previous; ///< State of an enclosing scope.
+};
+
+#endif
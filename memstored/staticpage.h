@@ -0,0 +1,136 @@
+#ifndef _memstored_staticpage_H
+#define _memstored_staticpage_H 1
+#include <grace/httpd.h>
+#include <grace/lock.h>
+#include "httpdstats.h"
+
+//  -------------------------------------------------------------------------
+/// An httpdobject for fixed content, like health checks and banners.
+/// The complete response (status line, headers and body) is serialized
+/// once and the cached bytes are written straight to the socket for
+/// every request. Call setcontent() when the content changes.
+//  -------------------------------------------------------------------------
+class StaticPage : public httpdobject
+{
+public:
+	/// Constructor: Set up object and content.
+	/// \param pparent The httpd to attach to.
+	/// \param uri The URI to respond to.
+	/// \param ctype The content-type.
+	/// \param body The response body.
+	StaticPage (httpd &pparent, const string &uri, const string &ctype,
+				const string &body) : httpdobject (pparent, uri)
+	{
+		setcontent (ctype, body);
+	}
+	
+	/// Boring virtual destructor.
+	~StaticPage (void)
+	{
+	}
+	
+	/// Replace the content, invalidating the cached response.
+	/// \param ctype The new content-type.
+	/// \param body The new response body.
+	void setcontent (const string &ctype, const string &body)
+	{
+		exclusivesection (response)
+		{
+			contenttype = ctype;
+			content = body;
+			response.crop ();
+		}
+	}
+	
+	/// Run-method, writes out the cached response. A negative return
+	/// value tells the httpd that the response was already sent.
+	/// \param uri The request URI
+	/// \param postbody Posted data
+	/// \param inhdr Input headers
+	/// \param out Output data
+	/// \param outhdr Output headers
+	/// \param env Meta-variables
+	/// \param s Raw socket.
+	int run (string &uri, string &postbody, value &inhdr,
+			 string &out, value &outhdr, value &env,
+			 tcpsocket &s)
+	{
+		requesttimer t (httpdstats::method (env));
+		string raw;
+		
+		sharedsection (response)
+		{
+			raw = response;
+		}
+		
+		if (! raw.strlen())
+		{
+			exclusivesection (response)
+			{
+				if (! response.strlen())
+				{
+					response = "HTTP/1.1 200 OK\r\n"
+							   "Content-type: %s\r\n"
+							   "Content-length: %i\r\n"
+							   "Connection: close\r\n\r\n"
+							   %format (contenttype, content.strlen());
+					response.strcat (content);
+				}
+				raw = response;
+			}
+		}
+		
+		s.puts (raw);
+		return -200;
+	}
+
+protected:
+	lock<string>	 response; ///< Cached serialized response.
+	string			 contenttype; ///< Content-type of the body.
+	string			 content; ///< The response body.
+};
+
+//  -------------------------------------------------------------------------
+/// The same fixed content through the regular serverpage path, where
+/// the httpd builds the headers for every request. memload compares
+/// the two to show what StaticPage saves.
+//  -------------------------------------------------------------------------
+class ExecutePage : public serverpage
+{
+public:
+	/// Constructor: Set up serverpage and content.
+	/// \param pparent The httpd to attach to.
+	/// \param uri The URI to respond to.
+	/// \param ctype The content-type.
+	/// \param body The response body.
+	ExecutePage (httpd &pparent, const string &uri, const string &ctype,
+				 const string &body) : serverpage (pparent, uri)
+	{
+		contenttype = ctype;
+		content = body;
+	}
+	
+	/// Boring virtual destructor.
+	~ExecutePage (void)
+	{
+	}
+	
+	/// Serverpage execution, copies out the content.
+	/// \param env Meta variables.
+	/// \param argv POST or GET variables.
+	/// \param out Output page.
+	/// \param outhdr Output headers.
+	int execute (value &env, value &argv, string &out, value &outhdr)
+	{
+		requesttimer t (httpdstats::method (env));
+		outhdr["Content-type"] = contenttype;
+		out = content;
+		return 200;
+	}
+
+protected:
+	string			 contenttype; ///< Content-type of the body.
+	string			 content; ///< The response body.
+};
+
+#endif
@@ -0,0 +1,131 @@
+#include "wire.h"
+#include "httpdstats.h"
+#include <grace/daemon.h>
+
+// ==========================================================================
+// CONSTRUCTOR MemStoreWire
+// ==========================================================================
+MemStoreWire::MemStoreWire (threadgroup &grp, MemStore &st,
+							lock<tcplistener> &l)
+	: groupthread (grp), store (st), listener (l)
+{
+	spawn ();
+}
+
+// ==========================================================================
+// DESTRUCTOR MemStoreWire
+// ==========================================================================
+MemStoreWire::~MemStoreWire (void)
+{
+}
+
+// ==========================================================================
+// METHOD MemStoreWire::run
+// ==========================================================================
+void MemStoreWire::run (void)
+{
+	while (true)
+	{
+		tcpsocket s;
+		exclusivesection (listener)
+		{
+			s = listener.o.accept ();
+		}
+		
+		while (handle (s));
+		s.close ();
+	}
+}
+
+// ==========================================================================
+// METHOD MemStoreWire::handle
+// ==========================================================================
+bool MemStoreWire::handle (tcpsocket &s)
+{
+	string hdr = s.read (4);
+	if (hdr.strlen() < 4) return false;
+	
+	unsigned int len = getint (hdr, 0, 4);
+	if ((len < 9) || (len > (64*1024*1024))) return false;
+	
+	string frame = s.read (len);
+	if (frame.strlen() < len) return false;
+	
+	char op = frame[0];
+	unsigned int keylen = getint (frame, 1, 2);
+	unsigned int typelen = getint (frame, 3, 2);
+	int ttl = getint (frame, 5, 4);
+	if ((9 + keylen + typelen) > len) return false;
+	
+	int method = HTTPDSTATS_OTHER;
+	if (op == 'G') method = HTTPDSTATS_GET;
+	else if (op == 'U') method = HTTPDSTATS_PUT;
+	else if (op == 'P') method = HTTPDSTATS_POST;
+	else if (op == 'D') method = HTTPDSTATS_DELETE;
+	requesttimer t (method);
+	
+	statstring uri = frame.mid (9, keylen);
+	value v = $("Content-type", frame.mid (9 + keylen, typelen)) ->
+			  $("data", frame.mid (9 + keylen + typelen));
+	
+	int status = 500;
+	string outtype = "text/plain";
+	string out;
+	
+	if (store.isreadonly() && (op != 'G'))
+	{
+		status = 405;
+		op = 0;
+	}
+	
+	switch (op)
+	{
+		case 'G':
+			if (store.get (uri, v))
+			{
+				status = 200;
+				outtype = v["Content-type"];
+				out = v["data"].sval();
+			}
+			else
+			{
+				status = 404;
+				out = "Not found";
+			}
+			break;
+		
+		case 'U':
+			v = store.put (uri, v, ttl);
+			status = v["ok"] ? 200 : 405;
+			out = v["error"];
+			log::write (log::info, "memstore", "wire store <%s>" %format (uri));
+			break;
+			
+		case 'P':
+			v = store.post (uri, v, ttl);
+			status = v["ok"] ? 200 : 404;
+			out = v["error"];
+			log::write (log::info, "memstore", "wire update <%s>" %format (uri));
+			break;
+		
+		case 'D':
+			v = store.del (uri);
+			status = v["ok"] ? 200 : 404;
+			out = v["error"];
+			log::write (log::info, "memstore", "wire delete <%s>" %format (uri));
+			break;
+		
+		default:
+			out = (status == 405) ? "Read-only replica" : "Unknown operation";
+			break;
+	}
+	
+	string reply;
+	putint (reply, 4 + outtype.strlen() + out.strlen(), 4);
+	putint (reply, status, 2);
+	putint (reply, outtype.strlen(), 2);
+	reply.strcat (outtype);
+	reply.strcat (out);
+	s.puts (reply);
+	return true;
+}
@@ -0,0 +1,67 @@
+#ifndef _memstored_wire_H
+#define _memstored_wire_H 1
+#include <grace/tcpsocket.h>
+#include <grace/thread.h>
+#include <grace/lock.h>
+#include "memstore.h"
+
+//  -------------------------------------------------------------------------
+/// Worker thread for the binary protocol, an alternative to HTTP for
+/// internal clients. Workers take turns accepting a connection on the
+/// shared listener and serve it until the client hangs up. Requests
+/// can be pipelined; replies go out in request order. All integers are
+/// in network byte order:
+///
+///   request:  u32 length, u8 op, u16 keylen, u16 typelen, u32 ttl,
+///             key, content-type, data
+///   reply:    u32 length, u16 status, u16 typelen, content-type, data
+///
+/// The length counts the bytes following it. Ops are 'G' (GET), 'U'
+/// (PUT), 'P' (POST) and 'D' (DELETE), with the same semantics and
+/// status codes as the HTTP interface. A non-zero ttl on PUT or POST
+/// works like the X-TTL header. Errors carry their message as
+/// text/plain data.
+//  -------------------------------------------------------------------------
+class MemStoreWire : public groupthread
+{
+public:
+					 /// Constructor.
+					 /// \param grp The group of binary protocol workers.
+					 /// \param st The store to serve.
+					 /// \param l The shared listening socket.
+					 MemStoreWire (threadgroup &grp, MemStore &st,
+					 			   lock<tcplistener> &l);
+					~MemStoreWire (void);
+					
+	void			 run (void);
+	
+protected:
+					 /// Read and answer one request.
+					 /// \return False if the connection should close.
+	bool			 handle (tcpsocket &s);
+	
+	MemStore		&store; ///< The store.
+	lock<tcplistener> &listener; ///< The listener shared by the workers.
+};
+
+//  =========================================================================
+/// Reads a big-endian integer of n bytes at offset pos. Shared by the
+/// server, replication and memload.
+//  =========================================================================
+inline unsigned int getint (const string &buf, int pos, int n)
+{
+	const unsigned char *p = (const unsigned char *) buf.str() + pos;
+	unsigned int res = 0;
+	for (int i=0; i<n; ++i) res = (res << 8) | p[i];
+	return res;
+}
+
+//  =========================================================================
+/// Appends a big-endian integer of n bytes.
+//  =========================================================================
+inline void putint (string &into, unsigned int v, int n)
+{
+	for (int i=n-1; i>=0; --i) into.strcat ((char) ((v >> (8*i)) & 0xff));
+}
+
+#endif
@@ -0,0 +1,165 @@
+#include "htmlcache.h"
+#include <grace/filesystem.h>
+#include "../common/filelock.h"
+
+// ==========================================================================
+// CONSTRUCTOR htmlcache
+// ==========================================================================
+htmlcache::htmlcache (void)
+{
+	hits = misses = 0;
+	maxsize = 0;
+	generation = 0;
+	dirty = false;
+}
+
+// ==========================================================================
+// DESTRUCTOR htmlcache
+// ==========================================================================
+htmlcache::~htmlcache (void)
+{
+}
+
+// ==========================================================================
+// METHOD htmlcache::open
+// ==========================================================================
+void htmlcache::open (const string &path, int maxbytes)
+{
+	cachepath = path;
+	maxsize = maxbytes;
+
+	if (fs.exists (cachepath))
+	{
+		if (! db.loadshox (cachepath)) db.clear ();
+	}
+
+	generation = db["generation"].ival() + 1;
+	db["generation"] = generation;
+}
+
+// ==========================================================================
+// METHOD htmlcache::close
+// ==========================================================================
+void htmlcache::close (void)
+{
+	if (! dirty) return;
+	
+	// Other mksite processes of a parallel build may have saved the
+	// cache since we loaded it, merge their entries in.
+	filelock lck ("%s.lock" %format (cachepath));
+	value ondisk;
+	if (fs.exists (cachepath) && ondisk.loadshox (cachepath))
+	{
+		foreach (e, ondisk["entries"])
+		{
+			if (! db["entries"].exists (e.id())) db["entries"][e.id()] = e;
+		}
+		if (ondisk["generation"].ival() > generation)
+		{
+			db["generation"] = ondisk["generation"];
+		}
+	}
+
+	value &entries = db["entries"];
+	value bygen;
+	int total = 0;
+	int oldest = generation;
+
+	foreach (e, entries)
+	{
+		total += e["html"].sval().strlen();
+		if (e["gen"].ival() < oldest) oldest = e["gen"].ival();
+		bygen[e["gen"].sval()].newval() = e.id().sval();
+	}
+
+	// Drop entries from the oldest generations first, until we fit.
+	for (int gen = oldest;
+		 (total > maxsize) && (gen < generation); ++gen)
+	{
+		string gid = "%i" %format (gen);
+		if (! bygen.exists (gid)) continue;
+
+		foreach (key, bygen[gid])
+		{
+			if (total <= maxsize) break;
+			total -= entries[key.sval()]["html"].sval().strlen();
+			entries.rmval (key.sval());
+		}
+	}
+
+	db.saveshox (cachepath);
+	dirty = false;
+}
+
+// ==========================================================================
+// METHOD htmlcache::makekey
+// ==========================================================================
+string *htmlcache::makekey (const string &highlighter, const string &src)
+{
+	returnclass (string) res retain;
+
+	if (! versions.exists (highlighter))
+	{
+		versions[highlighter] = checksum (fs.load (highlighter));
+	}
+
+	res = "%s:%s:" %format (highlighter, versions[highlighter]);
+	res.strcat (checksum (src));
+	return &res;
+}
+
+// ==========================================================================
+// METHOD htmlcache::lookup
+// ==========================================================================
+bool htmlcache::lookup (const string &key, string &into)
+{
+	if (! db["entries"].exists (key))
+	{
+		misses++;
+		return false;
+	}
+
+	value &e = db["entries"][key];
+	into = e["html"].sval();
+	if (e["gen"].ival() != generation)
+	{
+		e["gen"] = generation;
+		dirty = true;
+	}
+	hits++;
+	return true;
+}
+
+// ==========================================================================
+// METHOD htmlcache::store
+// ==========================================================================
+void htmlcache::store (const string &key, const string &html)
+{
+	db["entries"][key] = $("html", html) -> $("gen", generation);
+	dirty = true;
+}
+
+// ==========================================================================
+// METHOD htmlcache::checksum
+// ==========================================================================
+string *htmlcache::checksum (const string &dat)
+{
+	returnclass (string) res retain;
+	static const char *hex = "0123456789abcdef";
+
+	unsigned long long h = 14695981039346656037ULL;
+	const unsigned char *p = (const unsigned char *) dat.str();
+	unsigned int sz = dat.strlen();
+
+	for (unsigned int i=0; i<sz; ++i)
+	{
+		h ^= p[i];
+		h *= 1099511628211ULL;
+	}
+
+	for (int i=60; i>=0; i-=4)
+	{
+		res.strcat (hex[(h >> i) & 15]);
+	}
+	return &res;
+}
@@ -0,0 +1,59 @@
+#ifndef _mksite_htmlcache_H
+#define _mksite_htmlcache_H 1
+#include <grace/value.h>
+#include <grace/str.h>
+
+//  -------------------------------------------------------------------------
+/// Content-addressed cache of highlighted code blocks. Entries are keyed
+/// on the highlighter, a checksum of the highlighter binary (so that a
+/// rebuilt highlighter invalidates its entries) and a checksum of the
+/// snippet. The cache is kept in memory during a run and saved to disk
+/// at the end, dropping the least recently used entries when it grows
+/// beyond its size limit.
+//  -------------------------------------------------------------------------
+class htmlcache
+{
+public:
+					 htmlcache (void);
+					~htmlcache (void);
+
+					 /// Load the on-disk cache.
+					 /// \param path The cache file.
+					 /// \param maxbytes Size limit for the html data.
+	void			 open (const string &path, int maxbytes);
+
+					 /// Evict old entries and write the cache to disk.
+	void			 close (void);
+
+					 /// Create the lookup key for a snippet.
+					 /// \param highlighter Path to the highlighter binary.
+					 /// \param src The snippet source.
+	string			*makekey (const string &highlighter, const string &src);
+
+					 /// Look up a key.
+					 /// \param key The key returned by makekey().
+					 /// \param into Receives the cached html on a hit.
+					 /// \return True on a hit.
+	bool			 lookup (const string &key, string &into);
+
+					 /// Store generated html.
+					 /// \param key The key returned by makekey().
+					 /// \param html The highlighter output.
+	void			 store (const string &key, const string &html);
+
+	int				 hits; ///< Number of cache hits this run.
+	int				 misses; ///< Number of cache misses this run.
+
+protected:
+					 /// 64 bit FNV-1a checksum of a string, in hex.
+	static string	*checksum (const string &);
+
+	value			 db; ///< Cache data (generation, entries).
+	value			 versions; ///< Highlighter checksums by path.
+	string			 cachepath; ///< Location of the cache file.
+	int				 maxsize; ///< Size limit in bytes.
+	int				 generation; ///< Run counter, used for eviction.
+	bool			 dirty; ///< True if anything was stored.
+};
+
+#endif
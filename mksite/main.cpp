@@ -1,6 +1,12 @@
 #include "mksite.h"
 #include <grace/filesystem.h>
 #include <grace/system.h>
+#include "minify.h"
+#include "../common/linecursor.h"
+#include "../common/htmlescape.h"
+#include <sys/time.h>
+#include <ctype.h>
+#include <unistd.h>
 
 $appobject(mksiteApp);
 
@@ -9,11 +15,33 @@ $appobject(mksiteApp);
 // ==========================================================================
 int mksiteApp::main (void)
 {
+	if (argv.exists ("--minify"))
+	{
+		foreach (curfile, argv["*"]) postprocess (curfile);
+		return 0;
+	}
+	
+	// Temporary files carry the pid, so that a parallel build can run
+	// one mksite per page.
+	tmpsuffix = ".%i" %format (getpid());
+	cache.open (argv["--cache"], argv["--cache-size"]);
+	search.open (".searchindex");
+	string batchlist;
+	
+	string profile;
+	if (argv.exists ("--profile-out")) profile = argv["--profile-out"];
+	if (argv.exists ("--profile"))
+	{
+		profile = argv["--profile"];
+		fs.rm (profile);
+	}
+	
 	foreach (curfile, argv["*"])
 	{
 		fs.rm ("site/%s" %format (curfile));
 		fout.writeln (">>> %s" %format (curfile));
 		string filedat = fs.load (curfile);
+		indexpage (curfile, filedat);
 		
 		filedat.replace ($("<sym>","<<sym>>") ->
 						 $("</sym>","<</sym>>") ->
@@ -28,26 +56,24 @@ int mksiteApp::main (void)
 						 $("<h2>","<<section name=\"") ->
 						 $("</h2>","\">>"));
 		
-		value lines = strutil::splitlines (filedat);
+		linecursor lines (filedat);
 		outtext.crop ();
 
-		for (int i=0; i<lines.count(); ++i)
+		while (lines.next())
 		{
-			const string &line = lines[i];
-			string ln = line;
-			ln.chomp ();
-			if (ln.strlen() && (ln[0] == '%'))
+			if (iscommand (lines))
 			{
+				string ln = lines.str();
+				ln.chomp ();
 				string cmd = ln.cutat (' ');
 				caseselector (cmd)
 				{
 					incaseof ("%include") :
 						fout.writeln ("   include %s" %format (ln));
-						core.sh ("./grace2html/grace2html %s >> _html" %format (ln));
-						string txt = fs.load ("_html");
+						string txt = highlight ("./grace2html/grace2html",
+												fs.load (ln), ln);
 						txt.replace ($("$","$$"));
 						outtext.strcat (txt);
-						fs.rm ("_html");
 						break;
 						
 					incaseof ("%terminal") :
@@ -57,12 +83,12 @@ int mksiteApp::main (void)
 					
 					incaseof ("%code") :
 						fout.writeln ("   code %s" %format (ln));
-						handlecode (lines, i);
+						handlecode (lines);
 						break;
 					
 					incaseof ("%xmlcode") :
 						fout.writeln ("   xml %s" %format (ln));
-						handlexml (lines, i);
+						handlexml (lines);
 						break;
 						
 					defaultcase :
@@ -71,43 +97,187 @@ int mksiteApp::main (void)
 			}
 			else
 			{
-				outtext.strcat (line);
+				lines.appendto (outtext);
 				outtext.strcat ('\n');
 			}
 		}
 		fs.save ("%s.tmphtml" %format (curfile), outtext);
-		core.sh ("./htparse/htparse -x toc.xml -i template.thtml %s.tmphtml > site/%s"
-				 %format (curfile, curfile));
+		batchlist.strcat ("%s.tmphtml site/%s\n" %format (curfile, curfile));
+	}
+	
+	// All pages go through a single htparse, which loads the environment
+	// and template once and shares its section memo between them.
+	if (batchlist.strlen())
+	{
+		string envopt = "-x toc.xml ";
+		if (fs.exists ("toc.shox")) envopt = "-b toc.shox ";
+		if (fs.exists ("assets.xml")) envopt.strcat ("-a assets.xml ");
+		if (profile)
+		{
+			envopt.strcat ("--profile-out %s " %format (profile));
+		}
+		if (argv.exists ("--check-compiled"))
+		{
+			envopt.strcat ("--check-compiled %s "
+						   %format (argv["--check-compiled"]));
+		}
+		if (argv.exists ("--no-compiled")) envopt.strcat ("--no-compiled ");
 		
-		fs.rm ("%s.tmphtml" %format (curfile));
+		string listfile = ".htparse%s" %format (tmpsuffix);
+		fs.save (listfile, batchlist);
+		core.sh ("./htparse/htparse %s-i template.thtml --batch %s"
+				 %format (envopt, listfile));
+		fs.rm (listfile);
+		
+		foreach (curfile, argv["*"]) fs.rm ("%s.tmphtml" %format (curfile));
+	}
+	
+	fout.writeln ("*** code cache: %i hits, %i misses"
+				  %format (cache.hits, cache.misses));
+	cache.close ();
+	
+	int shards = search.close (argv["--search"]);
+	fout.writeln ("*** search index: %i shards updated" %format (shards));
+	
+	if (argv.exists ("--profile"))
+	{
+		fout.writeln ("*** template profile");
+		core.sh ("./htparse/htparse --profile-report %s" %format (profile));
 	}
 	return 0;
 }
 
+// ==========================================================================
+// METHOD mksiteApp::indexpage
+// ==========================================================================
+void mksiteApp::indexpage (const string &fname, const string &filedat)
+{
+	string text, title;
+	bool incode = false;
+	
+	linecursor lines (filedat);
+	while (lines.next())
+	{
+		if (incode)
+		{
+			if (isendcode (lines)) incode = false;
+			continue;
+		}
+		if (iscommand (lines))
+		{
+			string cmd = lines.str();
+			cmd.chomp ();
+			if ((cmd.left (5) == "%code") ||
+				(cmd.left (8) == "%xmlcode")) incode = true;
+			continue;
+		}
+		if (iscommand (lines, '@')) continue;
+		
+		lines.appendto (text);
+		text.strcat ('\n');
+	}
+	
+	int tpos = text.strstr ("<<page title=\"");
+	if (tpos >= 0)
+	{
+		title = text.mid (tpos + 14, 256);
+		title.crop (title.strchr ('"'));
+	}
+	
+	search.addpage (fname, title, text);
+}
+
+// ==========================================================================
+// METHOD mksiteApp::postprocess
+// ==========================================================================
+void mksiteApp::postprocess (const string &path)
+{
+	struct timeval tstart, tend;
+	gettimeofday (&tstart, NULL);
+	
+	string orig = fs.load (path);
+	string html = minifyhtml (orig);
+	fs.save (path, html);
+	
+	int level = argv["--gzip-level"];
+	int gzsize = 0;
+	if (level > 0)
+	{
+		core.sh ("gzip -%i -n -c %s > %s.gz" %format (level, path, path));
+		gzsize = fs.load ("%s.gz" %format (path)).strlen();
+	}
+	
+	gettimeofday (&tend, NULL);
+	int msec = ((tend.tv_sec - tstart.tv_sec) * 1000) +
+			   ((tend.tv_usec - tstart.tv_usec) / 1000);
+	int origsize = orig.strlen();
+	int saved = origsize ? (100 * (origsize - html.strlen())) / origsize : 0;
+	
+	fout.writeln ("   minify %s: %i -> %i bytes (-%i%%), gzip %i bytes, %i ms"
+				  %format (path, origsize, html.strlen(), saved, gzsize, msec));
+}
+
+// ==========================================================================
+// METHOD mksiteApp::highlight
+// ==========================================================================
+string *mksiteApp::highlight (const string &highlighter, const string &src,
+							  const string &srcfile)
+{
+	returnclass (string) res retain;
+	
+	string key = cache.makekey (highlighter, src);
+	if (cache.lookup (key, res)) return &res;
+	
+	string outfile = "_html%s" %format (tmpsuffix);
+	if (srcfile)
+	{
+		core.sh ("%s %s > %s" %format (highlighter, srcfile, outfile));
+	}
+	else
+	{
+		string codefile = "__code%s" %format (tmpsuffix);
+		fs.save (codefile, src);
+		core.sh ("%s %s > %s" %format (highlighter, codefile, outfile));
+		fs.rm (codefile);
+	}
+	
+	res = fs.load (outfile);
+	fs.rm (outfile);
+	cache.store (key, res);
+	return &res;
+}
+
 // ==========================================================================
 // METHOD mksiteApp::printterminal
 // ==========================================================================
 void mksiteApp::printterminal (const string &file)
 {
 	string dat = fs.load (file);
-	value lines = strutil::splitlines (dat);
+	linecursor lines (dat);
 
 	outtext.strcat ("<div class=\"terminal\"><pre>\n");
-	foreach (vln, lines)
+	while (lines.next())
 	{
-		string line = vln;
-		line.replace ($("$","$$")->$("<","&lt;")->$(">","&gt;"));
-		if (! line.strlen())
+		if (! lines.length())
 		{
 			outtext.strcat ('\n');
 			continue;
 		}
-		if (line[0] == '$')
+		
+		const char *ln = lines.line();
+		int sz = lines.length();
+		bool prompt = (ln[0] == '$');
+		if (prompt)
 		{
-			line = line.mid (2);
-			outtext.strcat ("<span class=\"prompt\">%s</span>\n" %format (line));
+			outtext.strcat ("<span class=\"prompt\">");
+			ln++;
+			sz--;
 		}
-		else outtext.strcat ("%s\n" %format (line));
+		
+		htmlescape::escape (outtext, ln, sz,
+							htmlescape::ltgt | htmlescape::dollar);
+		
+		outtext.strcat (prompt ? "</span>\n" : "\n");
 	}
 	outtext.strcat ("</pre></div>\n");
 }
@@ -115,48 +285,58 @@ void mksiteApp::printterminal (const string &file)
 // ==========================================================================
 // METHOD mksiteApp::handlecode
 // ==========================================================================
-void mksiteApp::handlecode (value &lines, int &i)
+void mksiteApp::handlecode (linecursor &lines)
 {
-	i++;
-	file outf;
-	outf.openwrite ("__code.cpp");
-	for (;i < lines.count(); ++i)
+	string src;
+	while (lines.next())
 	{
-		string ln = lines[i];
-		ln.chomp();
-		if (ln == "%endcode") break;
-		ln = lines[i].sval().mid(1);
+		if (isendcode (lines)) break;
+		string ln;
+		if (lines.length() > 1) ln.strcat (lines.line()+1, lines.length()-1);
 		ln.replace ($("$","$$")->$("@","$atsign$"));
-		outf.writeln (ln);
+		src.strcat (ln);
+		src.strcat ('\n');
 	}
-	outf.close ();
-	core.sh ("./grace2html/grace2html __code.cpp > _html");
-	outtext.strcat (fs.load ("_html"));
-	fs.rm ("__code.cpp");
-	fs.rm ("_html");
+	outtext.strcat (highlight ("./grace2html/grace2html", src, ""));
 }
 
 // ==========================================================================
 // METHOD mksiteApp::handlexml
 // ==========================================================================
-void mksiteApp::handlexml (value &lines, int &i)
+void mksiteApp::handlexml (linecursor &lines)
 {
-	i++;
-	file outf;
-	outf.openwrite ("__code.xml");
-	for (;i < lines.count(); ++i)
+	string src;
+	while (lines.next())
 	{
-		string ln = lines[i];
-		ln.chomp();
-		if (ln == "%endcode") break;
-		ln = lines[i].sval().mid(1);
+		if (isendcode (lines)) break;
+		string ln;
+		if (lines.length() > 1) ln.strcat (lines.line()+1, lines.length()-1);
 			ln.replace ($("$","$$"));
-		outf.writeln (ln);
+		src.strcat (ln);
+		src.strcat ('\n');
 	}
-	outf.close ();
-	core.sh ("./xml2html/xml2html __code.xml > _html");
-	outtext.strcat (fs.load ("_html"));
-	fs.rm ("__code.xml");
-	fs.rm ("_html");
+	outtext.strcat (highlight ("./xml2html/xml2html", src, ""));
+}
+
+// ==========================================================================
+// METHOD mksiteApp::iscommand
+// ==========================================================================
+bool mksiteApp::iscommand (const linecursor &lines, char prefix)
+{
+	int i = 0;
+	while ((i < lines.length()) &&
+		   isspace ((unsigned char) lines[i])) ++i;
+	return lines[i] == prefix;
 }
 
+// ==========================================================================
+// METHOD mksiteApp::isendcode
+// ==========================================================================
+bool mksiteApp::isendcode (const linecursor &lines)
+{
+	int i = 0;
+	int sz = lines.length();
+	while ((i < sz) && isspace ((unsigned char) lines[i])) ++i;
+	while ((sz > i) && isspace ((unsigned char) lines[sz-1])) --sz;
+	return ((sz - i) == 8) && (! strncmp (lines.line() + i, "%endcode", 8));
+}
@@ -0,0 +1,56 @@
+#include "minify.h"
+#include <ctype.h>
+#include <strings.h>
+
+// ==========================================================================
+// FUNCTION minifyhtml
+// ==========================================================================
+string *minifyhtml (const string &html)
+{
+	returnclass (string) res retain;
+	
+	const char *p = html.str();
+	int sz = html.strlen();
+	int i = 0;
+	
+	// Skip leading whitespace.
+	while ((i<sz) && isspace ((unsigned char) p[i])) ++i;
+	
+	while (i<sz)
+	{
+		if ((p[i] == '<') && ((i+4) < sz) &&
+			(! strncasecmp (p+i, "<pre", 4)) &&
+			((p[i+4] == '>') || isspace ((unsigned char) p[i+4])))
+		{
+			int end = i+4;
+			while ((end+6) <= sz)
+			{
+				if (! strncasecmp (p+end, "</pre>", 6)) break;
+				++end;
+			}
+			end = ((end+6) <= sz) ? end+6 : sz;
+			res.strcat (html.mid (i, end-i));
+			i = end;
+		}
+		else if (isspace ((unsigned char) p[i]))
+		{
+			bool newline = false;
+			while ((i<sz) && isspace ((unsigned char) p[i]))
+			{
+				if (p[i] == '\n') newline = true;
+				++i;
+			}
+			res.strcat (newline ? '\n' : ' ');
+		}
+		else
+		{
+			int j = i+1;
+			while ((j<sz) && (p[j] != '<') &&
+				   (! isspace ((unsigned char) p[j]))) ++j;
+			res.strcat (html.mid (i, j-i));
+			i = j;
+		}
+	}
+	
+	return &res;
+}
@@ -0,0 +1,13 @@
+#ifndef _mksite_minify_H
+#define _mksite_minify_H 1
+#include <grace/str.h>
+
+/// Collapse whitespace in generated html. Every run of whitespace
+/// outside of <pre> blocks is reduced to a single newline (if the run
+/// contained one) or a single space. Content of <pre> blocks, which
+/// holds the grace2html and %terminal output, is copied verbatim.
+/// \param html The page to minify.
+/// \return New string with the minified page.
+string *minifyhtml (const string &html);
+
+#endif
@@ -1,6 +1,9 @@
 #ifndef _mksite_H
 #define _mksite_H 1
 #include <grace/application.h>
+#include "htmlcache.h"
+#include "searchindex.h"
+#include "../common/linecursor.h"
 
 //  -------------------------------------------------------------------------
 /// Main application class.
@@ -11,17 +14,79 @@ public:
 		 	 mksiteApp (void) :
 				application ("nl.madscience.tools.mksite")
 			 {
+			 	opt = $("-h", $("long", "--help")) ->
+			 		  $("-c", $("long", "--cache")) ->
+			 		  $("-s", $("long", "--cache-size")) ->
+			 		  $("-m", $("long", "--minify")) ->
+			 		  $("-S", $("long", "--search")) ->
+			 		  $("-z", $("long", "--gzip-level")) ->
+			 		  $("-p", $("long", "--profile")) ->
+			 		  $("-P", $("long", "--profile-out")) ->
+			 		  $("-C", $("long", "--check-compiled")) ->
+			 		  $("-N", $("long", "--no-compiled")) ->
+			 		  $("--cache",
+			 		  		$("argc", 1) ->
+			 		  		$("default", ".htmlcache") ->
+			 		  		$("help", "Highlighted code cache file")
+			 		   ) ->
+			 		  $("--cache-size",
+			 		  		$("argc", 1) ->
+			 		  		$("default", 8388608) ->
+			 		  		$("help", "Cache size limit in bytes")
+			 		   ) ->
+			 		  $("--search",
+			 		  		$("argc", 1) ->
+			 		  		$("default", "site/search") ->
+			 		  		$("help", "Output directory for the search index")
+			 		   ) ->
+			 		  $("--minify",
+			 		  		$("argc", 0) ->
+			 		  		$("help", "Minify and compress rendered pages")
+			 		   ) ->
+			 		  $("--gzip-level",
+			 		  		$("argc", 1) ->
+			 		  		$("default", 9) ->
+			 		  		$("help", "Compression level for .gz files, "
+			 		  				  "0 to disable")
+			 		   ) ->
+			 		  $("--profile",
+			 		  		$("argc", 1) ->
+			 		  		$("help", "Profile the templates into this file, "
+			 		  				  "starting it fresh, and print the result")
+			 		   ) ->
+			 		  $("--profile-out",
+			 		  		$("argc", 1) ->
+			 		  		$("help", "Add template profiles to a file shared "
+			 		  				  "by a site build, without printing them")
+			 		   ) ->
+			 		  $("--check-compiled",
+			 		  		$("argc", 1) ->
+			 		  		$("help", "Compare compiled and interpreted @cache "
+			 		  				  "sections, add the results to this file")
+			 		   ) ->
+			 		  $("--no-compiled",
+			 		  		$("argc", 0) ->
+			 		  		$("help", "Render with the interpreter only")
+			 		   );
 			 }
 			~mksiteApp (void)
 			 {
 			 }
 
 	int		 main (void);
+	void	 postprocess (const string &);
 	void	 printterminal (const string &);
-	void	 handlecode (value &, int &);
-	void	 handlexml (value &, int &);
+	void	 handlecode (linecursor &);
+	void	 handlexml (linecursor &);
+	string	*highlight (const string &, const string &, const string &);
+	void	 indexpage (const string &, const string &);
+	bool	 iscommand (const linecursor &, char prefix = '%');
+	bool	 isendcode (const linecursor &);
 	
 	string	 outtext;
+	string	 tmpsuffix;
+	htmlcache cache;
+	searchindex search;
 };
 
 #endif
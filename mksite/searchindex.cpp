@@ -0,0 +1,203 @@
+#include "searchindex.h"
+#include <grace/filesystem.h>
+#include "../common/filelock.h"
+#include <ctype.h>
+
+// ==========================================================================
+// CONSTRUCTOR searchindex
+// ==========================================================================
+searchindex::searchindex (void)
+{
+}
+
+// ==========================================================================
+// DESTRUCTOR searchindex
+// ==========================================================================
+searchindex::~searchindex (void)
+{
+}
+
+// ==========================================================================
+// METHOD searchindex::open
+// ==========================================================================
+void searchindex::open (const string &statepath)
+{
+	path = statepath;
+	if (fs.exists (path))
+	{
+		if (! state.loadshox (path)) state.clear ();
+	}
+}
+
+// ==========================================================================
+// METHOD searchindex::addpage
+// ==========================================================================
+void searchindex::addpage (const string &fname, const string &title,
+						   const string &text)
+{
+	value terms;
+	const char *p = text.str();
+	int sz = text.strlen();
+	int i = 0;
+	
+	// The ctype functions take unsigned char values, bytes of UTF-8
+	// text are negative as a plain char.
+	while (i<sz)
+	{
+		if (p[i] == '<')
+		{
+			while ((i<sz) && (p[i] != '>')) ++i;
+			++i;
+			continue;
+		}
+		if (p[i] == '&')
+		{
+			while ((i<sz) && (p[i] != ';') &&
+				   (! isspace ((unsigned char) p[i]))) ++i;
+			++i;
+			continue;
+		}
+		if (! isalnum ((unsigned char) p[i]))
+		{
+			++i;
+			continue;
+		}
+		
+		string term;
+		while ((i<sz) && (isalnum ((unsigned char) p[i]) || (p[i] == '_')))
+		{
+			term.strcat ((char) tolower ((unsigned char) p[i]));
+			++i;
+		}
+		if ((term.strlen() > 1) && (term.strlen() <= 32))
+		{
+			terms[term] = terms[term].ival() + 1;
+		}
+	}
+	
+	value &page = state["pages"][fname];
+	if ((page["title"].sval() == title) && (page["terms"].tojson() == terms.tojson())) return;
+	
+	touch (page["terms"]);
+	touch (terms);
+	page["title"] = title;
+	page["terms"] = terms;
+	updated[fname] = page;
+	dirty["pages"] = true;
+}
+
+// ==========================================================================
+// METHOD searchindex::close
+// ==========================================================================
+int searchindex::close (const string &outdir)
+{
+	if ((! dirty.count()) && (! hasgone (state))) return 0;
+	
+	// Other mksite processes of a parallel build may have updated the
+	// state since we loaded it, build the shards from the merged state.
+	filelock lck ("%s.lock" %format (path));
+	value ondisk;
+	if (fs.exists (path) && ondisk.loadshox (path))
+	{
+		state = ondisk;
+		foreach (page, updated) state["pages"][page.id()] = page;
+	}
+	prune ();
+	
+	value shards;
+	foreach (page, state["pages"])
+	{
+		foreach (term, page["terms"])
+		{
+			string shard = shardof (term.id().sval());
+			if (! dirty.exists (shard)) continue;
+			shards[shard][term.id()].newval() =
+				$(page.id().sval()) -> $(term.ival());
+		}
+	}
+	
+	fs.mkdir (outdir);
+	
+	int count = 0;
+	foreach (shard, dirty)
+	{
+		if (shard.id() == "pages") continue;
+		
+		// All terms of a shard may have gone with a removed page.
+		string shardfile = "%s/%s.json" %format (outdir, shard.id());
+		if (shards.exists (shard.id()))
+		{
+			fs.save (shardfile, shards[shard.id()].tojson());
+		}
+		else
+		{
+			fs.rm (shardfile);
+		}
+		count++;
+	}
+	
+	value pages;
+	foreach (page, state["pages"])
+	{
+		pages[page.id()] = page["title"];
+	}
+	fs.save ("%s/pages.json" %format (outdir), pages.tojson());
+	
+	state.saveshox (path);
+	dirty.clear ();
+	updated.clear ();
+	return count;
+}
+
+// ==========================================================================
+// METHOD searchindex::hasgone
+// ==========================================================================
+bool searchindex::hasgone (const value &st)
+{
+	foreach (page, st["pages"])
+	{
+		if (! fs.exists (page.id().sval())) return true;
+	}
+	return false;
+}
+
+// ==========================================================================
+// METHOD searchindex::prune
+// ==========================================================================
+void searchindex::prune (void)
+{
+	value gone;
+	foreach (page, state["pages"])
+	{
+		if (fs.exists (page.id().sval())) continue;
+		touch (page["terms"]);
+		gone.newval() = page.id().sval();
+	}
+	
+	foreach (fname, gone)
+	{
+		state["pages"].rmval (fname.sval());
+		dirty["pages"] = true;
+	}
+}
+
+// ==========================================================================
+// METHOD searchindex::touch
+// ==========================================================================
+void searchindex::touch (const value &terms)
+{
+	foreach (term, terms)
+	{
+		dirty[shardof (term.id().sval())] = true;
+	}
+}
+
+// ==========================================================================
+// METHOD searchindex::shardof
+// ==========================================================================
+string *searchindex::shardof (const string &term)
+{
+	returnclass (string) res retain;
+	res = term.left (2);
+	return &res;
+}
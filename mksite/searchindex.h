@@ -0,0 +1,58 @@
+#ifndef _mksite_searchindex_H
+#define _mksite_searchindex_H 1
+#include <grace/value.h>
+#include <grace/str.h>
+
+//  -------------------------------------------------------------------------
+/// Inverted full-text index over the site pages. Pages are tokenized
+/// while mksite has them in memory; the per-page term counts are kept in
+/// a state file between builds so that only the shards holding terms of
+/// changed pages are rewritten. Shards are JSON files named after the
+/// first two characters of their terms, so a browser only fetches the
+/// shards for the terms it looks up.
+//  -------------------------------------------------------------------------
+class searchindex
+{
+public:
+					 searchindex (void);
+					~searchindex (void);
+
+					 /// Load the state of the previous build.
+					 /// \param statepath The state file.
+	void			 open (const string &statepath);
+
+					 /// Index the text of a page, replacing any older
+					 /// version of it.
+					 /// \param fname The page file name.
+					 /// \param title The page title.
+					 /// \param text Page text, markup is skipped.
+	void			 addpage (const string &fname, const string &title,
+							  const string &text);
+
+					 /// Write out the changed shards and the state.
+					 /// \param outdir Directory for the shard files.
+					 /// \return Number of shards written.
+	int				 close (const string &outdir);
+
+protected:
+					 /// Checks if a state lists pages whose source file
+					 /// no longer exists.
+	static bool		 hasgone (const value &st);
+
+					 /// Drop the pages whose source file was deleted or
+					 /// renamed, marking their shards as changed.
+	void			 prune (void);
+
+					 /// Mark the shards of all terms in a dict as changed.
+	void			 touch (const value &terms);
+
+					 /// Shard name for a term.
+	static string	*shardof (const string &term);
+
+	value			 state; ///< Per-page titles and term counts.
+	value			 dirty; ///< Shards that need to be rewritten.
+	value			 updated; ///< Pages changed in this run.
+	string			 path; ///< Location of the state file.
+};
+
+#endif
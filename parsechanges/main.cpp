@@ -1,6 +1,8 @@
 #include "parsechanges.h"
 #include <grace/strutil.h>
 #include <grace/filesystem.h>
+#include "../common/linecursor.h"
+#include "../common/htmlescape.h"
 
 $appobject(parsechangesApp);
 
@@ -9,39 +11,71 @@ $appobject(parsechangesApp);
 // ==========================================================================
 int parsechangesApp::main (void)
 {
-	string doc = fs.load (argv["--input"]);
 	value res;
+	string changesfile = basepath (argv["--toc"]);
+	changesfile.strcat (".changes.shox");
+	
+	if (! argv.exists ("--changes-only")) res.loadxml (argv["--toc"]);
+	
+	if (argv.exists ("--head"))
+	{
+		savehead (res, argv["--toc"]);
+		return 0;
+	}
+	
+	if (argv.exists ("--merge"))
+	{
+		res["changes"].loadshox (changesfile);
+	}
+	else
+	{
+		parse (res["changes"]);
+	}
 	
-	res.loadxml (argv["--toc"]);
+	if (argv.exists ("--changes-only"))
+	{
+		res["changes"].saveshox (changesfile);
+		return 0;
+	}
 	
-	value &out = res["changes"];
+	res.savexml (argv["--toc"]);
+	savebinary (res, argv["--toc"]);
+	return 0;
+}
+
+// ==========================================================================
+// METHOD parsechangesApp::parse
+// ==========================================================================
+void parsechangesApp::parse (value &out)
+{
+	string doc = fs.load (argv["--input"]);
 	int bulletno = -1;
 	statstring curversion;
 	string curline;
 	
-	value lines = strutil::splitlines (doc);
-	foreach (line, lines)
+	linecursor lines (doc);
+	while (lines.next())
 	{
-		const string &ln = line;
-		if (ln.strlen())
+		if (lines.length())
 		{
-			if (isdigit (ln[0]))
+			if (isdigit ((unsigned char) lines[0]))
 			{
 				if (curline && bulletno>=0)
 				{
 					out[curversion]["bullets"][bulletno]["bullet"] = curline;
 					curline.crop ();
 				}
-				value splt = strutil::splitspace (ln);
+				value splt = strutil::splitspace (lines.str());
 				curversion = splt[0];
 				out[curversion]["date"] =
 					"%s %s %s %s" %format (splt[1],splt[2],splt[3],splt[4]);
 				bulletno = -1;
 				continue;
 			}
-			string l = ln;
+			string l;
+			htmlescape::escape (l, lines.line(), lines.length(),
+								htmlescape::ltgt);
 			l.chomp ();
-			l.replace ($("<","&lt;") -> $(">","&gt;"));
 			
 			if (l.strlen() && l[0] == '*')
 			{
@@ -66,7 +100,44 @@ int parsechangesApp::main (void)
 	{
 		out[curversion]["bullets"][bulletno]["bullet"] = curline;
 	}
+}
+
+// ==========================================================================
+// METHOD parsechangesApp::basepath
+// ==========================================================================
+string *parsechangesApp::basepath (const string &xmlpath)
+{
+	returnclass (string) res retain;
 	
-	res.savexml (argv["--toc"]);
-	return 0;
+	res = xmlpath;
+	if (res.strlen() > 4 && res.mid (res.strlen() - 4) == ".xml")
+	{
+		res.crop (res.strlen() - 4);
+	}
+	return &res;
+}
+
+// ==========================================================================
+// METHOD parsechangesApp::savebinary
+// ==========================================================================
+void parsechangesApp::savebinary (value &toc, const string &xmlpath)
+{
+	string base = basepath (xmlpath);
+	toc["changes"].saveshox ("%s.changes.shox" %format (base));
+	savehead (toc, xmlpath);
+}
+
+// ==========================================================================
+// METHOD parsechangesApp::savehead
+// ==========================================================================
+void parsechangesApp::savehead (const value &toc, const string &xmlpath)
+{
+	string base = basepath (xmlpath);
+	
+	// The changelog is only needed by the downloads page, so it goes in
+	// its own file that htparse loads when a template refers to it.
+	value head = toc;
+	head.rmval ("changes");
+	head["_lazy"]["changes"] = "%s.changes.shox" %format (base);
+	head.saveshox ("%s.shox" %format (base));
 }
@@ -14,6 +14,9 @@ public:
 				 	opt = $("-h", $("long", "--help")) ->
 				 		  $("-t", $("long", "--toc")) ->
 				 		  $("-i", $("long", "--input")) ->
+				 		  $("-c", $("long", "--changes-only")) ->
+				 		  $("-m", $("long", "--merge")) ->
+				 		  $("-H", $("long", "--head")) ->
 				 		  $("--toc",
 				 		  	$("argc",1) ->
 				 		  	$("default","toc.xml") ->
@@ -23,6 +26,20 @@ public:
 				 		  	$("argc", 1) ->
 				 		  	$("default","Changes.txt") ->
 				 		  	$("help","Location of the Changes.txt file")
+				 		   ) ->
+				 		  $("--changes-only",
+				 		  	$("argc",0) ->
+				 		  	$("help","Only write the binary changelog")
+				 		   ) ->
+				 		  $("--merge",
+				 		  	$("argc",0) ->
+				 		  	$("help","Merge a binary changelog written "
+				 		  			 "by --changes-only into the toc")
+				 		   ) ->
+				 		  $("--head",
+				 		  	$("argc",0) ->
+				 		  	$("help","Only write the binary toc, pointing "
+				 		  			 "at the changelog --changes-only writes")
 				 		   );
 				 }
 				~parsechangesApp (void)
@@ -30,6 +47,10 @@ public:
 				 }
 	
 	int			 main (void);
+	void		 parse (value &out);
+	string		*basepath (const string &xmlpath);
+	void		 savebinary (value &toc, const string &xmlpath);
+	void		 savehead (const value &toc, const string &xmlpath);
 
 };
 
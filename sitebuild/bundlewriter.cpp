@@ -0,0 +1,304 @@
+#include "bundlewriter.h"
+#include <grace/filesystem.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../common/sitebundle.h"
+
+//  -------------------------------------------------------------------------
+/// Site path of an entry, for sorting.
+//  -------------------------------------------------------------------------
+struct bundlekey
+{
+	const char		*path; ///< The path.
+	unsigned int	 len; ///< Its length.
+	int				 idx; ///< Index in the file list.
+};
+
+//  =========================================================================
+/// Sort order of the bundle index, must match sitebundle::find().
+//  =========================================================================
+static int cmpkey (const void *a, const void *b)
+{
+	const bundlekey *ka = (const bundlekey *) a;
+	const bundlekey *kb = (const bundlekey *) b;
+	unsigned int n = (ka->len < kb->len) ? ka->len : kb->len;
+	int c = memcmp (ka->path, kb->path, n);
+	if (! c) c = (int) ka->len - (int) kb->len;
+	return c;
+}
+
+//  =========================================================================
+/// Quoted FNV-1a hash of the data, for use as an ETag.
+//  =========================================================================
+static string *makeetag (const string &dat)
+{
+	returnclass (string) res retain;
+	static const char *hex = "0123456789abcdef";
+
+	unsigned long long h = 14695981039346656037ULL;
+	const unsigned char *p = (const unsigned char *) dat.str();
+	unsigned int sz = dat.strlen();
+	for (unsigned int i=0; i<sz; ++i)
+	{
+		h ^= p[i];
+		h *= 1099511628211ULL;
+	}
+
+	res = "\"";
+	for (int i=60; i>=0; i-=4) res.strcat (hex[(h >> i) & 15]);
+	res.strcat ('"');
+	return &res;
+}
+
+//  =========================================================================
+/// Appends a string to the string table and notes where it went.
+//  =========================================================================
+static void addstring (string &strtab, uint64_t base, const string &s,
+					   uint64_t &off, uint32_t &len)
+{
+	off = base + strtab.strlen();
+	len = s.strlen();
+	strtab.strcat (s);
+}
+
+//  =========================================================================
+/// Rounds an offset up to the blob alignment.
+//  =========================================================================
+static uint64_t align (uint64_t off)
+{
+	return (off + SITEBUNDLE_ALIGN - 1) & ~((uint64_t) SITEBUNDLE_ALIGN - 1);
+}
+
+//  =========================================================================
+/// Pads a buffer with zeroes up to an offset.
+//  =========================================================================
+static void padto (string &into, uint64_t off)
+{
+	while (into.strlen() < off) into.strcat ((char) 0);
+}
+
+// ==========================================================================
+// CONSTRUCTOR bundlewriter
+// ==========================================================================
+bundlewriter::bundlewriter (void)
+{
+	count = size = 0;
+}
+
+// ==========================================================================
+// DESTRUCTOR bundlewriter
+// ==========================================================================
+bundlewriter::~bundlewriter (void)
+{
+}
+
+// ==========================================================================
+// METHOD bundlewriter::adddir
+// ==========================================================================
+void bundlewriter::adddir (const string &root, const string &prefix)
+{
+	DIR *dir = opendir (root.str());
+	if (! dir) return;
+
+	value gzipped;
+	struct dirent *de;
+	while ((de = readdir (dir)))
+	{
+		string name = de->d_name;
+		if (name[0] == '.') continue;
+
+		string full = "%s/%s" %format (root, name);
+		string path = "%s/%s" %format (prefix, name);
+
+		struct stat st;
+		if (stat (full.str(), &st) != 0) continue;
+		if (S_ISDIR (st.st_mode))
+		{
+			adddir (full, path);
+			continue;
+		}
+
+		// Precompressed siblings are matched up after the loop.
+		if ((name.strlen() > 3) && (name.mid (name.strlen() - 3) == ".gz"))
+		{
+			gzipped[path] = full;
+			continue;
+		}
+
+		files[path]["file"] = full;
+	}
+	closedir (dir);
+
+	foreach (gz, gzipped)
+	{
+		string path = gz.id().sval();
+		string plain = path.left (path.strlen() - 3);
+		if (files.exists (plain)) files[plain]["gz"] = gz;
+		else files[path]["file"] = gz;
+	}
+}
+
+// ==========================================================================
+// METHOD bundlewriter::write
+// ==========================================================================
+bool bundlewriter::write (const string &path)
+{
+	int cnt = files.count();
+	bundlekey *keys = new bundlekey[cnt ? cnt : 1];
+	for (int i=0; i<cnt; ++i)
+	{
+		const string &p = files[i].id().sval();
+		keys[i].path = p.str();
+		keys[i].len = p.strlen();
+		keys[i].idx = i;
+	}
+	qsort (keys, cnt, sizeof (bundlekey), cmpkey);
+
+	bundleentry *ents = new bundleentry[cnt ? cnt : 1];
+	memset (ents, 0, sizeof (bundleentry) * (cnt ? cnt : 1));
+
+	uint64_t indexoff = align (sizeof (bundleheader));
+	uint64_t strbase = indexoff + (cnt * sizeof (bundleentry));
+	string strtab;
+	value blobs;
+
+	for (int i=0; i<cnt; ++i)
+	{
+		const value &f = files[keys[i].idx];
+		bundleentry &e = ents[i];
+		string p = f.id().sval();
+		string raw = fs.load (f["file"]);
+		string gz;
+		if (f.exists ("gz")) gz = fs.load (f["gz"]);
+
+		string ctype = contenttype (p);
+		string etag = makeetag (raw);
+		string vary = gz.strlen() ? "Vary: Accept-encoding\r\n" : "";
+
+		addstring (strtab, strbase, p, e.pathoff, e.pathlen);
+		addstring (strtab, strbase, ctype, e.typeoff, e.typelen);
+		addstring (strtab, strbase, etag, e.etagoff, e.etaglen);
+		addstring (strtab, strbase,
+				   "HTTP/1.1 200 OK\r\n"
+				   "Content-type: %s\r\n"
+				   "Content-length: %i\r\n"
+				   "ETag: %s\r\n%s"
+				   "Connection: close\r\n\r\n"
+				   %format (ctype, raw.strlen(), etag, vary),
+				   e.hdroff, e.hdrlen);
+		addstring (strtab, strbase,
+				   "HTTP/1.1 304 Not Modified\r\n"
+				   "ETag: %s\r\n%s"
+				   "Connection: close\r\n\r\n" %format (etag, vary),
+				   e.nmhdroff, e.nmhdrlen);
+		if (gz.strlen())
+		{
+			// A cache must not answer a request for the raw bytes
+			// with the gzip ones, so they get an ETag of their own.
+			string gzetag = makeetag (gz);
+			addstring (strtab, strbase, gzetag, e.gzetagoff, e.gzetaglen);
+			addstring (strtab, strbase,
+					   "HTTP/1.1 200 OK\r\n"
+					   "Content-type: %s\r\n"
+					   "Content-encoding: gzip\r\n"
+					   "Content-length: %i\r\n"
+					   "ETag: %s\r\n%s"
+					   "Connection: close\r\n\r\n"
+					   %format (ctype, gz.strlen(), gzetag, vary),
+					   e.gzhdroff, e.gzhdrlen);
+			addstring (strtab, strbase,
+					   "HTTP/1.1 304 Not Modified\r\n"
+					   "ETag: %s\r\n%s"
+					   "Connection: close\r\n\r\n" %format (gzetag, vary),
+					   e.gznmhdroff, e.gznmhdrlen);
+		}
+
+		e.datasize = raw.strlen();
+		e.gzsize = gz.strlen();
+		blobs.newval() = raw;
+		blobs.newval() = gz;
+	}
+
+	uint64_t off = align (strbase + strtab.strlen());
+	for (int i=0; i<cnt; ++i)
+	{
+		ents[i].dataoff = off;
+		off = align (off + ents[i].datasize);
+		ents[i].gzoff = ents[i].gzsize ? off : 0;
+		off = align (off + ents[i].gzsize);
+	}
+
+	bundleheader h;
+	memset (&h, 0, sizeof (h));
+	memcpy (h.magic, SITEBUNDLE_MAGIC, 8);
+	h.bom = SITEBUNDLE_BOM;
+	h.count = cnt;
+	h.indexoff = indexoff;
+	h.size = off;
+
+	string out;
+	out.strcat ((const char *) &h, sizeof (h));
+	padto (out, indexoff);
+	if (cnt) out.strcat ((const char *) ents, cnt * sizeof (bundleentry));
+	out.strcat (strtab);
+
+	for (int i=0; i<cnt; ++i)
+	{
+		padto (out, ents[i].dataoff);
+		out.strcat (blobs[2*i].sval());
+		if (ents[i].gzsize)
+		{
+			padto (out, ents[i].gzoff);
+			out.strcat (blobs[(2*i)+1].sval());
+		}
+	}
+	padto (out, off);
+
+	delete[] keys;
+	delete[] ents;
+
+	string tmp = "%s.tmp" %format (path);
+	if (! fs.save (tmp, out)) return false;
+	if (rename (tmp.str(), path.str()) != 0) return false;
+
+	count = cnt;
+	size = out.strlen();
+	return true;
+}
+
+// ==========================================================================
+// METHOD bundlewriter::contenttype
+// ==========================================================================
+string *bundlewriter::contenttype (const string &path)
+{
+	returnclass (string) res retain;
+	static const char *types[] = {
+		".html", "text/html",
+		".css", "text/css",
+		".js", "application/javascript",
+		".json", "application/json",
+		".xml", "text/xml",
+		".txt", "text/plain",
+		".png", "image/png",
+		".jpg", "image/jpeg",
+		".jpeg", "image/jpeg",
+		".gif", "image/gif",
+		".svg", "image/svg+xml",
+		".ico", "image/x-icon",
+		NULL, NULL
+	};
+
+	res = "application/octet-stream";
+	for (int i=0; types[i]; i+=2)
+	{
+		int l = strlen (types[i]);
+		if ((path.strlen() > (unsigned int) l) &&
+			(path.mid (path.strlen() - l) == types[i]))
+		{
+			res = types[i+1];
+			break;
+		}
+	}
+	return &res;
+}
@@ -0,0 +1,40 @@
+#ifndef _sitebuild_bundlewriter_H
+#define _sitebuild_bundlewriter_H 1
+#include <grace/value.h>
+#include <grace/str.h>
+
+//  -------------------------------------------------------------------------
+/// Writes the built site as a single bundle file (see
+/// common/sitebundle.h): a sorted path index, content types, ETags and
+/// ready-made response headers, followed by the raw bytes of every file
+/// and, where a .gz sibling exists, its precompressed bytes.
+//  -------------------------------------------------------------------------
+class bundlewriter
+{
+public:
+					 bundlewriter (void);
+					~bundlewriter (void);
+
+					 /// Add the files below a directory.
+					 /// \param root The directory.
+					 /// \param prefix Path of the directory in the site.
+	void			 adddir (const string &root, const string &prefix = "");
+
+					 /// Write the bundle. The file is replaced in one
+					 /// step, so servers can map the old one until they
+					 /// reopen.
+					 /// \param path The bundle file.
+					 /// \return False if it could not be written.
+	bool			 write (const string &path);
+
+					 /// Guess a content type from a file name.
+	static string	*contenttype (const string &path);
+
+	int				 count; ///< Files in the last bundle written.
+	int				 size; ///< Size of the last bundle written.
+
+protected:
+	value			 files; ///< File and .gz sibling by site path.
+};
+
+#endif
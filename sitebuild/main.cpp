@@ -0,0 +1,198 @@
+#include "sitebuild.h"
+#include "taskgraph.h"
+#include "bundlewriter.h"
+#include <grace/filesystem.h>
+#include <grace/system.h>
+#include <glob.h>
+#include <unistd.h>
+
+APPOBJECT(sitebuildApp);
+
+/// Render groups made per worker, so the pool has work to steal.
+#define SITEBUILD_GROUPSPERWORKER 4
+
+//  =========================================================================
+/// Checks if page or template source uses the changelog, which is
+/// written by a task of its own.
+//  =========================================================================
+static bool useschanges (const string &src)
+{
+	return (src.strstr ("@loop changes") >= 0) ||
+		   (src.strstr ("$changes") >= 0);
+}
+
+//  =========================================================================
+/// Cuts a list of pages into render groups.
+/// \param groups Array to add the groups to.
+/// \param pages The pages.
+/// \param pergroup Number of pages per group.
+/// \param changes True if the pages need the changelog.
+//  =========================================================================
+static void addgroups (value &groups, const value &pages, int pergroup,
+					   bool changes)
+{
+	for (int i=0; i<pages.count(); i+=pergroup)
+	{
+		value &grp = groups.newval();
+		grp["changes"] = changes;
+		for (int j=i; (j < (i+pergroup)) && (j < pages.count()); ++j)
+		{
+			grp["pages"].newval() = pages[j];
+		}
+	}
+}
+
+//  =========================================================================
+/// Main method. Sets up the build stages and per-page tasks as a
+/// dependency graph and runs them on the worker pool.
+//  =========================================================================
+int sitebuildApp::main (void)
+{
+	taskgraph G;
+	value nodeps;
+	
+	G.add ("assets", "./build_assets", nodeps);
+	G.add ("toc", "./build_toc --no-changes && "
+		   "./parsechanges/parsechanges --head", nodeps);
+	G.add ("changes", "./parsechanges/parsechanges --changes-only", nodeps);
+	
+	int level = argv["--gzip-level"];
+	string profopt;
+	if (argv.exists ("--profile"))
+	{
+		fs.rm (argv["--profile"]);
+		profopt = "--profile-out %s " %format (argv["--profile"]);
+	}
+	if (argv.exists ("--check-compiled"))
+	{
+		fs.rm (argv["--check-compiled"]);
+		profopt.strcat ("--check-compiled %s "
+						%format (argv["--check-compiled"]));
+	}
+	if (argv.exists ("--no-compiled")) profopt.strcat ("--no-compiled ");
+	
+	int jobs = argv["--jobs"];
+	if (jobs < 1) jobs = sysconf (_SC_NPROCESSORS_ONLN);
+	if (jobs < 1) jobs = 1;
+	
+	// Pages are rendered a few at a time, one mksite and so one htparse
+	// --batch per group, in several groups per worker so that idle
+	// workers can steal render work from busy ones. Rendering starts as
+	// soon as the toc is ready; only groups with a page that uses the
+	// changelog wait for it. A page is minified once its group is done.
+	value mergedeps = $("toc") -> $("changes");
+	glob_t pages;
+	if (glob ("*.html", 0, NULL, &pages) == 0)
+	{
+		int npages = pages.gl_pathc;
+		int pergroup = npages / (jobs * SITEBUILD_GROUPSPERWORKER);
+		if (pergroup < 1) pergroup = 1;
+		
+		bool tmplchanges = useschanges (fs.load ("template.thtml"));
+		value plain, withchanges;
+		for (int i=0; i<npages; ++i)
+		{
+			string page = pages.gl_pathv[i];
+			if (tmplchanges || useschanges (fs.load (page)))
+			{
+				withchanges.newval() = page;
+			}
+			else plain.newval() = page;
+		}
+		globfree (&pages);
+		
+		value groups;
+		addgroups (groups, plain, pergroup, false);
+		addgroups (groups, withchanges, pergroup, true);
+		
+		for (int g=0; g<groups.count(); ++g)
+		{
+			const value &grp = groups[g];
+			string render = "render group %i" %format (g+1);
+			string cmd = "./mksite/mksite %s" %format (profopt);
+			foreach (page, grp["pages"]) cmd.strcat ("%s " %format (page));
+			
+			value deps = $("toc") -> $("assets");
+			if (grp["changes"].bval()) deps.newval() = "changes";
+			G.add (render, cmd, deps);
+			mergedeps.newval() = render;
+			
+			foreach (page, grp["pages"])
+			{
+				G.add ("minify %s" %format (page),
+					   "./mksite/mksite --minify --gzip-level %i site/%s"
+					   %format (level, page), $(render));
+			}
+		}
+	}
+	
+	// The full toc.xml is written last, so it doesn't change under the
+	// renders.
+	G.add ("tocmerge", "./parsechanges/parsechanges --merge", mergedeps);
+	
+	fout.writeln ("* Building site with %i workers" %format (jobs));
+	bool ok = G.run (jobs);
+	G.report ();
+	
+	if (ok && argv.exists ("--bundle"))
+	{
+		bundlewriter B;
+		B.adddir ("site");
+		if (! B.write (argv["--bundle"]))
+		{
+			ferr.writeln ("%% Could not write %s" %format (argv["--bundle"]));
+			return 1;
+		}
+		fout.writeln ("*** bundle: %i files, %i bytes in %s"
+					  %format (B.count, B.size, argv["--bundle"]));
+	}
+	
+	if (argv.exists ("--profile"))
+	{
+		fout.writeln ("*** template profile");
+		core.sh ("./htparse/htparse --profile-report %s"
+				 %format (argv["--profile"]));
+	}
+	
+	if (ok && argv.exists ("--check-compiled"))
+	{
+		ok = checkreport (argv["--check-compiled"]);
+	}
+	
+	return ok ? 0 : 1;
+}
+
+//  =========================================================================
+/// Prints the comparison of compiled and interpreted @cache sections
+/// collected by the htparse runs. Sections are only compared when the
+/// memo renders them, so a section that is never a miss isn't listed.
+/// \param path The file they added their results to.
+/// \return False if a section differed or the renderers are stale.
+//  =========================================================================
+bool sitebuildApp::checkreport (const string &path)
+{
+	value res;
+	if (fs.exists (path)) res.loadxml (path);
+	
+	fout.writeln ("*** compiled template check: %i htparse runs"
+				  %format (res["runs"].ival()));
+	
+	if (res["stale"].bval())
+	{
+		ferr.writeln ("% The compiled sections are not made from this "
+					  "template, rebuild htparse");
+		return false;
+	}
+	
+	bool ok = true;
+	foreach (sec, res["sections"])
+	{
+		fout.writeln ("   %s: %i same, %i different"
+					  %format (sec.id(), sec["agreed"].ival(),
+					  		   sec["differed"].ival()));
+		if (sec["differed"].ival()) ok = false;
+	}
+	
+	if (! ok) ferr.writeln ("% Compiled sections differ from the interpreter");
+	return ok;
+}
@@ -0,0 +1,60 @@
+#ifndef _sitebuild_H
+#define _sitebuild_H 1
+#include <grace/application.h>
+
+//  -------------------------------------------------------------------------
+/// Main application class.
+//  -------------------------------------------------------------------------
+class sitebuildApp : public application
+{
+public:
+		 	 sitebuildApp (void) :
+				application ("nl.madscience.tools.sitebuild")
+			 {
+			 	opt = $("-j", $("long", "--jobs")) ->
+			 		  $("-z", $("long", "--gzip-level")) ->
+			 		  $("-p", $("long", "--profile")) ->
+			 		  $("-b", $("long", "--bundle")) ->
+			 		  $("-c", $("long", "--check-compiled")) ->
+			 		  $("-N", $("long", "--no-compiled")) ->
+			 		  $("-h", $("long", "--help")) ->
+			 		  $("--jobs",
+			 		  		$("argc", 1) ->
+			 		  		$("default", 0) ->
+			 		  		$("help", "Number of workers, 0 for one per core")
+			 		   ) ->
+			 		  $("--gzip-level",
+			 		  		$("argc", 1) ->
+			 		  		$("default", 9) ->
+			 		  		$("help", "Compression level for .gz files, "
+			 		  				  "0 to disable")
+			 		   ) ->
+			 		  $("--profile",
+			 		  		$("argc", 1) ->
+			 		  		$("help", "Profile the templates of all pages into "
+			 		  				  "this file and print the result")
+			 		   ) ->
+			 		  $("--bundle",
+			 		  		$("argc", 1) ->
+			 		  		$("help", "Also write the site as a single bundle file")
+			 		   ) ->
+			 		  $("--check-compiled",
+			 		  		$("argc", 1) ->
+			 		  		$("help", "Check the compiled @cache sections against "
+			 		  				  "the interpreter on every memo miss, "
+			 		  				  "results in this file")
+			 		   ) ->
+			 		  $("--no-compiled",
+			 		  		$("argc", 0) ->
+			 		  		$("help", "Render with the interpreter only")
+			 		   );
+			 }
+			~sitebuildApp (void)
+			 {
+			 }
+
+	int		 main (void);
+	bool	 checkreport (const string &path);
+};
+
+#endif
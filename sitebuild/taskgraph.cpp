@@ -0,0 +1,323 @@
+#include "taskgraph.h"
+#include <grace/application.h>
+#include <grace/system.h>
+#include <sys/time.h>
+
+//  -------------------------------------------------------------------------
+/// Arguments for a worker thread.
+//  -------------------------------------------------------------------------
+struct workerarg
+{
+	taskgraph		*graph; ///< The graph to work on.
+	int				 id; ///< The worker number.
+	bool			 started; ///< True if the thread was created.
+};
+
+//  =========================================================================
+/// Thread entry point for a worker.
+//  =========================================================================
+static void *taskworker (void *arg)
+{
+	workerarg *w = (workerarg *) arg;
+	w->graph->work (w->id);
+	return NULL;
+}
+
+// ==========================================================================
+// CONSTRUCTOR taskgraph
+// ==========================================================================
+taskgraph::taskgraph (void)
+{
+	maxtasks = 64;
+	ntasks = 0;
+	tasks = new buildtask[maxtasks];
+	queues = NULL;
+	nworkers = 0;
+	ready = pending = 0;
+	t0 = wall = 0.0;
+	pthread_mutex_init (&idlelock, NULL);
+	pthread_cond_init (&idle, NULL);
+}
+
+// ==========================================================================
+// DESTRUCTOR taskgraph
+// ==========================================================================
+taskgraph::~taskgraph (void)
+{
+	delete[] tasks;
+	pthread_cond_destroy (&idle);
+	pthread_mutex_destroy (&idlelock);
+}
+
+// ==========================================================================
+// METHOD taskgraph::add
+// ==========================================================================
+int taskgraph::add (const string &name, const string &cmd, const value &deps)
+{
+	if (ntasks == maxtasks)
+	{
+		buildtask *ntab = new buildtask[maxtasks*2];
+		for (int i=0; i<ntasks; ++i) ntab[i] = tasks[i];
+		delete[] tasks;
+		tasks = ntab;
+		maxtasks *= 2;
+	}
+
+	int id = ntasks++;
+	buildtask &t = tasks[id];
+	t.name = name;
+	t.cmd = cmd;
+	t.waiting = 0;
+	t.start = t.end = 0.0;
+	t.failed = false;
+
+	foreach (dep, deps)
+	{
+		if (! ids.exists (dep.sval())) continue;
+		int depid = ids[dep.sval()];
+		t.deps.newval() = depid;
+		tasks[depid].dependents.newval() = id;
+		t.waiting++;
+	}
+
+	ids[name] = id;
+	return id;
+}
+
+// ==========================================================================
+// METHOD taskgraph::run
+// ==========================================================================
+bool taskgraph::run (int numworkers)
+{
+	nworkers = numworkers;
+	queues = new taskdeque[nworkers];
+	for (int i=0; i<nworkers; ++i)
+	{
+		pthread_mutex_init (&queues[i].lock, NULL);
+		queues[i].items = new int[ntasks ? ntasks : 1];
+		queues[i].head = queues[i].tail = 0;
+	}
+
+	t0 = 0.0;
+	t0 = now ();
+	pending = ntasks;
+
+	int w = 0;
+	for (int i=0; i<ntasks; ++i)
+	{
+		if (tasks[i].waiting) continue;
+		push (w, i);
+		w = (w+1) % nworkers;
+	}
+
+	pthread_t *threads = new pthread_t[nworkers];
+	workerarg *args = new workerarg[nworkers];
+	for (int i=0; i<nworkers; ++i)
+	{
+		args[i].graph = this;
+		args[i].id = i;
+		args[i].started = false;
+		if (i)
+		{
+			args[i].started = (pthread_create (&threads[i], NULL,
+											   taskworker, &args[i]) == 0);
+		}
+	}
+	
+	// Queues of workers that didn't start are emptied by stealing.
+	work (0);
+	for (int i=1; i<nworkers; ++i)
+	{
+		if (args[i].started) pthread_join (threads[i], NULL);
+	}
+	wall = now ();
+
+	for (int i=0; i<nworkers; ++i)
+	{
+		pthread_mutex_destroy (&queues[i].lock);
+		delete[] queues[i].items;
+	}
+	delete[] queues;
+	delete[] threads;
+	delete[] args;
+	queues = NULL;
+
+	bool ok = true;
+	for (int i=0; i<ntasks; ++i) if (tasks[i].failed) ok = false;
+	return ok;
+}
+
+// ==========================================================================
+// METHOD taskgraph::work
+// ==========================================================================
+void taskgraph::work (int id)
+{
+	while (true)
+	{
+		int tid = take (id);
+		if (tid < 0)
+		{
+			pthread_mutex_lock (&idlelock);
+			while ((! ready) && pending) pthread_cond_wait (&idle, &idlelock);
+			bool done = (pending == 0);
+			pthread_mutex_unlock (&idlelock);
+			if (done) break;
+			continue;
+		}
+
+		buildtask &t = tasks[tid];
+		t.start = now ();
+		if (! t.failed)
+		{
+			if (core.sh (t.cmd) != 0) t.failed = true;
+		}
+		t.end = now ();
+
+		pthread_mutex_lock (&idlelock);
+		fout.writeln ("   %s %s (%.2fs)" %format (t.failed ? "FAIL" : "done",
+						t.name, t.end - t.start));
+		pthread_mutex_unlock (&idlelock);
+
+		finish (id, tid);
+	}
+}
+
+// ==========================================================================
+// METHOD taskgraph::take
+// ==========================================================================
+int taskgraph::take (int id)
+{
+	int res = -1;
+
+	// Newest task from our own queue first, it is the one most likely
+	// to use files that were just written.
+	taskdeque &own = queues[id];
+	pthread_mutex_lock (&own.lock);
+	if (own.tail > own.head)
+	{
+		res = own.items[--own.tail];
+		countready (-1);
+	}
+	pthread_mutex_unlock (&own.lock);
+
+	// Otherwise steal the oldest task of another worker.
+	for (int i=1; (res < 0) && (i < nworkers); ++i)
+	{
+		taskdeque &victim = queues[(id+i) % nworkers];
+		pthread_mutex_lock (&victim.lock);
+		if (victim.tail > victim.head)
+		{
+			res = victim.items[victim.head++];
+			countready (-1);
+		}
+		pthread_mutex_unlock (&victim.lock);
+	}
+
+	return res;
+}
+
+// ==========================================================================
+// METHOD taskgraph::push
+// ==========================================================================
+void taskgraph::push (int worker, int task)
+{
+	taskdeque &q = queues[worker];
+	pthread_mutex_lock (&q.lock);
+	if (q.head == q.tail) q.head = q.tail = 0;
+	q.items[q.tail++] = task;
+	countready (1);
+	pthread_mutex_unlock (&q.lock);
+}
+
+// ==========================================================================
+// METHOD taskgraph::countready
+// ==========================================================================
+void taskgraph::countready (int delta)
+{
+	// Called with a queue lock held, so the counter changes together
+	// with the queue and never counts a task that isn't queued. Queue
+	// locks are always taken before idlelock.
+	pthread_mutex_lock (&idlelock);
+	ready += delta;
+	if (delta > 0) pthread_cond_broadcast (&idle);
+	pthread_mutex_unlock (&idlelock);
+}
+
+// ==========================================================================
+// METHOD taskgraph::finish
+// ==========================================================================
+void taskgraph::finish (int worker, int task)
+{
+	value runnable;
+
+	pthread_mutex_lock (&idlelock);
+	foreach (dep, tasks[task].dependents)
+	{
+		buildtask &d = tasks[dep.ival()];
+		if (tasks[task].failed) d.failed = true;
+		if (--d.waiting == 0) runnable.newval() = dep.ival();
+	}
+	pending--;
+	pthread_cond_broadcast (&idle);
+	pthread_mutex_unlock (&idlelock);
+
+	foreach (r, runnable) push (worker, r.ival());
+}
+
+// ==========================================================================
+// METHOD taskgraph::report
+// ==========================================================================
+void taskgraph::report (void)
+{
+	if (! ntasks) return;
+
+	// Tasks are added after their dependencies, so index order is a
+	// topological order.
+	double *pathlen = new double[ntasks];
+	int *via = new int[ntasks];
+	double busy = 0.0;
+	int last = 0;
+
+	for (int i=0; i<ntasks; ++i)
+	{
+		double dur = tasks[i].end - tasks[i].start;
+		busy += dur;
+		pathlen[i] = dur;
+		via[i] = -1;
+		foreach (dep, tasks[i].deps)
+		{
+			int d = dep.ival();
+			if ((pathlen[d] + dur) > pathlen[i])
+			{
+				pathlen[i] = pathlen[d] + dur;
+				via[i] = d;
+			}
+		}
+		if (pathlen[i] > pathlen[last]) last = i;
+	}
+
+	fout.writeln ("*** critical path: %.2fs of %.2fs wall time, "
+				  "pool %i%% busy" %format (pathlen[last], wall,
+				  (int) ((100.0 * busy) / (wall * nworkers))));
+
+	value chain;
+	for (int i=last; i>=0; i=via[i]) chain.newval() = i;
+	for (int i=chain.count()-1; i>=0; --i)
+	{
+		buildtask &t = tasks[chain[i].ival()];
+		fout.writeln ("    %.2fs %s" %format (t.end - t.start, t.name));
+	}
+
+	delete[] pathlen;
+	delete[] via;
+}
+
+// ==========================================================================
+// METHOD taskgraph::now
+// ==========================================================================
+double taskgraph::now (void)
+{
+	struct timeval tv;
+	gettimeofday (&tv, NULL);
+	return (tv.tv_sec + (tv.tv_usec / 1000000.0)) - t0;
+}
@@ -0,0 +1,100 @@
+#ifndef _sitebuild_taskgraph_H
+#define _sitebuild_taskgraph_H 1
+#include <grace/value.h>
+#include <grace/str.h>
+#include <pthread.h>
+
+//  -------------------------------------------------------------------------
+/// A shell command in the build graph.
+//  -------------------------------------------------------------------------
+struct buildtask
+{
+	string			 name; ///< Display name.
+	string			 cmd; ///< Shell command.
+	value			 deps; ///< Ids of the tasks this one waits for.
+	value			 dependents; ///< Ids of the tasks waiting for this one.
+	int				 waiting; ///< Number of unfinished dependencies.
+	double			 start; ///< Start time, seconds into the build.
+	double			 end; ///< End time, seconds into the build.
+	bool			 failed; ///< True if the command or a dependency failed.
+};
+
+//  -------------------------------------------------------------------------
+/// Per-worker double-ended queue of runnable task ids. The owner pushes
+/// and pops at the tail, idle workers steal from the head.
+//  -------------------------------------------------------------------------
+struct taskdeque
+{
+	pthread_mutex_t	 lock; ///< Protects the queue.
+	int				*items; ///< Task ids, sized for all tasks.
+	int				 head; ///< Index of the oldest entry.
+	int				 tail; ///< Index past the newest entry.
+};
+
+//  -------------------------------------------------------------------------
+/// Dependency graph of build tasks, executed on a work-stealing pool of
+/// worker threads. Tasks become runnable the moment their last
+/// dependency finishes and are queued on the worker that finished it.
+/// Afterwards the critical path through the graph is reported.
+//  -------------------------------------------------------------------------
+class taskgraph
+{
+public:
+					 taskgraph (void);
+					~taskgraph (void);
+
+					 /// Add a task. Dependencies must already be added.
+					 /// \param name Unique task name.
+					 /// \param cmd Shell command to run.
+					 /// \param deps Array of names of tasks to wait for.
+					 /// \return The task id.
+	int				 add (const string &name, const string &cmd,
+						  const value &deps);
+
+					 /// Run all tasks.
+					 /// \param nworkers Number of worker threads.
+					 /// \return False if any task failed.
+	bool			 run (int nworkers);
+
+					 /// Print the critical path and pool utilization.
+	void			 report (void);
+
+					 /// Worker thread body.
+					 /// \param id The worker number.
+	void			 work (int id);
+
+protected:
+					 /// Take a task from our own queue, or steal one.
+					 /// \return Task id, or -1 if all queues are empty.
+	int				 take (int id);
+
+					 /// Queue a runnable task on a worker.
+	void			 push (int worker, int task);
+
+					 /// Adjust the number of queued tasks.
+					 /// \param delta 1 for a push, -1 for a take.
+	void			 countready (int delta);
+
+					 /// Mark a task finished and release its dependents.
+	void			 finish (int worker, int task);
+
+					 /// Seconds since the build started.
+	double			 now (void);
+
+	buildtask		*tasks; ///< Task table.
+	int				 ntasks; ///< Number of tasks.
+	int				 maxtasks; ///< Size of the task table.
+	value			 ids; ///< Task ids by name.
+
+	taskdeque		*queues; ///< One queue per worker.
+	int				 nworkers; ///< Number of workers.
+	int				 ready; ///< Queued tasks, under idlelock and the
+									///< lock of the queue that changed.
+	int				 pending; ///< Unfinished tasks, under idlelock.
+	pthread_mutex_t	 idlelock; ///< Protects the counters.
+	pthread_cond_t	 idle; ///< Signalled when work arrives or ends.
+	double			 t0; ///< Start of the build.
+	double			 wall; ///< Wall time of the build.
+};
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef _xml2html_xmlhighlight_H
+#define _xml2html_xmlhighlight_H 1
+#include <grace/str.h>
+#include "../common/htmlescape.h"
+
+//  -------------------------------------------------------------------------
+/// The XML to HTML conversion of xml2html, kept apart from the tool so
+/// the escaping check can run it against the old byte-at-a-time loop.
+//  -------------------------------------------------------------------------
+class xmlhighlight
+{
+public:
+					 /// Appends the highlighted form of an XML buffer.
+					 /// \param res The string to append to.
+					 /// \param p Start of the XML.
+					 /// \param sz Size of the XML.
+	static void		 convert (string &res, const char *p, int sz)
+					 {
+					 	int i = 0;
+					 	while (i<sz)
+					 	{
+					 		int run = htmlescape::scan (p+i, sz-i, "< \t\n");
+					 		if (run) res.strcat (p+i, run);
+					 		i += run;
+					 		if (i>=sz) break;
+
+					 		if (p[i] == '<')
+					 		{
+					 			bool inspan=true;
+					 			++i;
+					 			res.strcat ("<span class=\"xmltag\">&lt;");
+					 			while ((i<sz) && (p[i] != '>'))
+					 			{
+					 				run = htmlescape::scan (p+i, sz-i,
+					 										inspan ? "\"> " : "\">");
+					 				if (run) res.strcat (p+i, run);
+					 				i += run;
+					 				if ((i>=sz) || (p[i] == '>')) break;
+
+					 				if (p[i] == '\"')
+					 				{
+					 					res.strcat ("</span><span class=\"string\">\"");
+					 					++i;
+					 					run = htmlescape::scan (p+i, sz-i, "\"");
+					 					if (run) res.strcat (p+i, run);
+					 					i += run;
+					 					res.strcat ("\"</span><span class=\"xmlattr\">");
+					 				}
+					 				else
+					 				{
+					 					res.strcat ("</span> <span class=\"xmlattr\">");
+					 					inspan = false;
+					 				}
+					 				++i;
+					 			}
+					 			if (! inspan) res.strcat ("</span><span class=\"xmltag\">");
+					 			res.strcat ("&gt;</span>");
+					 		}
+					 		else if (p[i] == ' ')
+					 		{
+					 			if (((i+1)<sz) && (p[i+1] == ' '))
+					 			{
+					 				res.strcat ("&nbsp;");
+					 				++i;
+					 			}
+					 			res.strcat (' ');
+					 		}
+					 		else if (p[i] == '\t')
+					 		{
+					 			res.strcat ("&nbsp; &nbsp; ");
+					 		}
+					 		else
+					 		{
+					 			res.strcat ("<br/>\n");
+					 		}
+					 		++i;
+					 	}
+					 }
+};
+
+#endif